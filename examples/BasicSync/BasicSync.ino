@@ -10,9 +10,11 @@
  * 
  * Upload this sketch to multiple ESP32 boards and watch them synchronize!
  * The LED will pulse for 100ms every second in perfect sync across all nodes.
+ * The pulses come from a MeshTicker, locked to whole seconds of mesh time.
  */
 
 #include <ESPNowMeshClock.h>
+#include <MeshTicker.h>
 
 // Pin configuration - adjust for your board
 #define SYNC_LED_PIN 2  // GPIO2 (built-in LED on most ESP32 boards)
@@ -24,6 +26,18 @@
 // - 5000ms sync timeout
 ESPNowMeshClock meshClock;
 
+// 100ms pulse at every whole second of mesh time
+MeshTicker pulse(meshClock);
+uint64_t pulseTick = 0;  // Last tick, reported from loop()
+portMUX_TYPE pulseLock = portMUX_INITIALIZER_UNLOCKED;  // 64-bit: not written in one go
+
+void onPulse(uint64_t tick, void *arg) {
+    // Runs in the timer task: keep it short, print from loop()
+    portENTER_CRITICAL(&pulseLock);
+    pulseTick = tick;
+    portEXIT_CRITICAL(&pulseLock);
+}
+
 void setup() {
     Serial.begin(115200);
     delay(1000);
@@ -38,6 +52,10 @@ void setup() {
     
     // Initialize the mesh clock
     meshClock.begin();
+
+    // The ticker drives the LED itself, right on the mesh second
+    pulse.setPin(SYNC_LED_PIN, 100000);
+    pulse.begin(1000000, onPulse);
 }
 
 void loop() {
@@ -66,24 +84,19 @@ void loop() {
     }
     
     // Synchronized LED pulse every second
-    // All nodes will pulse their LED at EXACTLY the same time
+    // All nodes pulse their LED at EXACTLY the same time
     // Perfect for visual validation or oscilloscope measurement
-    static uint32_t lastPulse = 0;
-    uint32_t meshMs = meshClock.meshMillis();
+    static uint64_t reportedTick = 0;
+    portENTER_CRITICAL(&pulseLock);
+    uint64_t tick = pulseTick;
+    portEXIT_CRITICAL(&pulseLock);
     
-    // Check if it's time for a pulse (every 1000ms)
-    if (meshMs - lastPulse >= 1000) {
-        lastPulse = meshMs;
-        
-        // HIGH for 100ms - DO THIS FIRST before any Serial.print
-        digitalWrite(SYNC_LED_PIN, HIGH);
-        uint64_t meshUs = meshClock.meshMicros();  // Capture precise time
-        delayMicroseconds(100000);  // 100ms = 100,000µs
-        digitalWrite(SYNC_LED_PIN, LOW);
+    if (tick != reportedTick) {
+        reportedTick = tick;
+        MeshTickerStats stats = pulse.getStats();
         
-        // Now safe to print (after pin changes to preserve timing accuracy)
-        Serial.printf("[PULSE] Mesh time: %llu µs (%u ms) - State: ", 
-                      meshUs, meshMs);
+        Serial.printf("[PULSE] Mesh second %llu (late %.1f µs avg, %u µs max) - State: ",
+                      tick, stats.meanLateUs, stats.maxLateUs);
         
         switch(currentState) {
             case SyncState::ALONE:
@@ -24,9 +24,12 @@ ESPNowMeshClock meshClock;
 
 // Your custom ESP-NOW receive callback
 void onESPNowReceive(const uint8_t *mac, const uint8_t *data, int len) {
+    // Latch arrival time first, before any other work in this callback
+    uint64_t rxMicros = fastmicros64_isr();
+
     // OPTION 1: Let mesh clock try to handle the packet first
     // It will check for 10-byte packets with \"MCK\" magic header
-    if (meshClock.handleReceive(mac, data, len)) {
+    if (meshClock.handleReceive(mac, data, len, rxMicros)) {
         // It was a mesh clock packet (10 bytes: \"MCK\" + timestamp), already processed
         Serial.println(\"[ESP-NOW] Mesh clock packet received\");
         return;
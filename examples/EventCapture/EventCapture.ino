@@ -0,0 +1,48 @@
+/*
+ * ESPNowMeshClock - Event Capture in Mesh Time
+ *
+ * Timestamps the edges of a GPIO in mesh time: the interrupt latches the
+ * clock and converts it, loop() prints the queued events. Wire the same
+ * signal (a button, a sensor trigger, a timecode output) to CAPTURE_PIN on
+ * several nodes: the mesh times they print for one edge differ only by the
+ * sync error between them.
+ *
+ * On most ESP32 boards GPIO 0 is the BOOT button, handy for a first try.
+ */
+
+#include <ESPNowMeshClock.h>
+#include <MeshCapture.h>
+
+#define CAPTURE_PIN 0
+
+ESPNowMeshClock meshClock;
+MeshCapture capture(meshClock);
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.println("\n=== Event Capture ===");
+
+    meshClock.begin();
+    capture.begin(CAPTURE_PIN, FALLING);
+}
+
+void loop() {
+    meshClock.loop();
+
+    MeshCaptureEvent event;
+    while (capture.read(event)) {
+        Serial.printf("[EDGE] pin %u -> %s at mesh %llu us (%s)\n",
+                      event.pin, event.level ? "HIGH" : "LOW", event.meshUs,
+                      meshClock.getSyncState() == SyncState::SYNCED ? "SYNCED" : "not synced");
+    }
+
+    static uint32_t lastDropped = 0;
+    if (capture.getDropped() != lastDropped) {
+        lastDropped = capture.getDropped();
+        Serial.printf("[EDGE] %u edges dropped (queue full)\n", lastDropped);
+    }
+
+    delay(1);
+}
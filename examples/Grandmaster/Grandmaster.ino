@@ -0,0 +1,50 @@
+/*
+ * ESPNowMeshClock - Elected Grandmaster
+ *
+ * Instead of following the most advanced clock (which lets the fastest
+ * crystal drag the whole mesh ahead of real time), the nodes elect one
+ * grandmaster and follow it in both directions. Mesh time then runs at the
+ * grandmaster's rate, e.g. the node wired to the media server.
+ *
+ * Flash this sketch on every node. Give the preferred master a lower
+ * priority value (MASTER_PRIORITY); ties go to the lowest MAC. Power the
+ * master off: another node takes over within a few broadcast intervals.
+ */
+
+#include <ESPNowMeshClock.h>
+
+// Lower wins. Use e.g. 10 on the node that should lead, keep 128 elsewhere.
+#define MASTER_PRIORITY 128
+
+ESPNowMeshClock meshClock;
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.println("\n=== Elected Grandmaster ===");
+
+    meshClock.setSyncMode(SyncMode::GRANDMASTER);
+    meshClock.setPriority(MASTER_PRIORITY);
+    meshClock.setFrequencyGain(0.1);  // Followers lock their rate to the master's
+    meshClock.begin();
+}
+
+void loop() {
+    meshClock.loop();
+
+    static uint32_t lastReport = 0;
+    if (millis() - lastReport >= 1000) {
+        lastReport = millis();
+
+        if (meshClock.isGrandmaster()) {
+            Serial.printf("[MASTER] %llu us\n", meshClock.meshMicros());
+        } else {
+            Serial.printf("[FOLLOW] %llu us  master %08X, %u hops, rate %+.2f ppm\n",
+                          meshClock.meshMicros(), meshClock.getReference(),
+                          meshClock.getStratum(), meshClock.getFrequencyPpm());
+        }
+    }
+
+    delay(1);
+}
@@ -0,0 +1,85 @@
+/*
+ * ESPNowMeshClock - meshMicros() Benchmark
+ *
+ * Measures the cost of meshMicros() in CPU cycles per call, next to the
+ * raw clocks it competes with, and checks that mesh time read concurrently
+ * on both cores never goes backwards while sync packets keep updating it.
+ *
+ * Run it on two or more boards (the others can run BasicSync) so the offset
+ * is being updated from the ESP-NOW receive callback during the test.
+ * Flash the same sketch against an older library release to compare.
+ */
+
+#include <ESPNowMeshClock.h>
+#include <esp_timer.h>
+
+#define CALLS 10000
+
+ESPNowMeshClock meshClock;
+
+volatile uint32_t backwards[2] = {0, 0};
+volatile uint32_t reads[2] = {0, 0};
+
+// Average cycles per call of fn over CALLS calls (loop overhead included)
+template<typename F>
+float cyclesPerCall(F fn) {
+    volatile uint64_t sink = 0;
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < CALLS; i++) {
+        sink = fn();
+    }
+    uint32_t cycles = ESP.getCycleCount() - start;
+    (void)sink;
+    return (float)cycles / CALLS;
+}
+
+// Hammer meshMicros() and count any value lower than the previous one
+void monotonicTask(void *arg) {
+    int core = (int)(intptr_t)arg;
+    uint64_t last = meshClock.meshMicros();
+    for (;;) {
+        for (int i = 0; i < 1000; i++) {
+            uint64_t now = meshClock.meshMicros();
+            if (now < last) backwards[core]++;
+            last = now;
+        }
+        reads[core] += 1000;
+        vTaskDelay(1);
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.println("\n=== meshMicros() Benchmark ===");
+    Serial.printf("CPU: %u MHz\n\n", getCpuFrequencyMhz());
+
+    meshClock.setDebugLog(0);
+    meshClock.begin();
+
+    xTaskCreatePinnedToCore(monotonicTask, "mono0", 2048, (void*)0, 1, nullptr, 0);
+    xTaskCreatePinnedToCore(monotonicTask, "mono1", 2048, (void*)1, 1, nullptr, 1);
+}
+
+void loop() {
+    meshClock.loop();
+
+    static uint32_t lastReport = 0;
+    if (millis() - lastReport < 5000) {
+        delay(1);
+        return;
+    }
+    lastReport = millis();
+
+    float mesh = cyclesPerCall([] { return meshClock.meshMicros(); });
+    float fast = cyclesPerCall([] { return fastmicros64_isr(); });
+    float timer = cyclesPerCall([] { return (uint64_t)esp_timer_get_time(); });
+    float ard = cyclesPerCall([] { return (uint64_t)micros(); });
+
+    Serial.printf("[BENCH] cycles/call  meshMicros: %.1f  fastmicros64_isr: %.1f  esp_timer_get_time: %.1f  micros: %.1f\n",
+                  mesh, fast, timer, ard);
+    Serial.printf("[BENCH] concurrent reads  core0: %u (%u backwards)  core1: %u (%u backwards)  state: %s\n",
+                  reads[0], backwards[0], reads[1], backwards[1],
+                  meshClock.getSyncState() == SyncState::SYNCED ? "SYNCED" : "not synced");
+}
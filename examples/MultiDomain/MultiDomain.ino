@@ -0,0 +1,56 @@
+/*
+ * ESPNowMeshClock - Multiple Clock Domains
+ *
+ * One node taking part in two independent mesh clocks, e.g. a bridge
+ * between a stage mesh and a house mesh. Each ESPNowMeshClock instance gets
+ * its own domain id; packets carry that id, and the single ESP-NOW receive
+ * callback dispatches them to the matching instance. With batching on, the
+ * bridge sends both clocks in one frame.
+ *
+ * Flash this sketch on the bridge. For the meshes themselves, set
+ * meshClock.setDomain(STAGE_DOMAIN) or setDomain(HOUSE_DOMAIN) before
+ * begin() in any other example (e.g. BasicSync).
+ */
+
+#include <ESPNowMeshClock.h>
+
+#define STAGE_DOMAIN 1
+#define HOUSE_DOMAIN 2
+
+ESPNowMeshClock stageClock;
+ESPNowMeshClock houseClock;
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.println("\n=== Multiple Clock Domains ===");
+
+    stageClock.setDomain(STAGE_DOMAIN);
+    houseClock.setDomain(HOUSE_DOMAIN);
+    stageClock.setBatching(true);
+    houseClock.setBatching(true);
+
+    // Only one instance registers the ESP-NOW callback, it serves both domains
+    stageClock.begin();
+    houseClock.begin(false);
+}
+
+void loop() {
+    stageClock.loop();
+    houseClock.loop();
+
+    static uint32_t lastReport = 0;
+    if (millis() - lastReport >= 1000) {
+        lastReport = millis();
+
+        uint64_t stage = stageClock.meshMicros();
+        uint64_t house = houseClock.meshMicros();
+        Serial.printf("[STAGE] %llu us (%s)  [HOUSE] %llu us (%s)  house - stage: %lld us\n",
+                      stage, stageClock.getSyncState() == SyncState::SYNCED ? "SYNCED" : "not synced",
+                      house, houseClock.getSyncState() == SyncState::SYNCED ? "SYNCED" : "not synced",
+                      (int64_t)(house - stage));
+    }
+
+    delay(1);
+}
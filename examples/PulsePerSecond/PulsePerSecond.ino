@@ -0,0 +1,46 @@
+/*
+ * ESPNowMeshClock - Pulse Per Second Output
+ *
+ * Puts a 100 µs pulse on a GPIO at every whole second of mesh time. The
+ * edge is driven by a hardware timer alarm, not from loop(), so it carries
+ * no task jitter. Flash this sketch on several nodes, probe PPS_PIN on each
+ * with a scope or logic analyzer and trigger on one of them: the spread of
+ * the rising edges is the real skew between the boards.
+ */
+
+#include <ESPNowMeshClock.h>
+#include <MeshPPS.h>
+
+#define PPS_PIN 4
+
+ESPNowMeshClock meshClock;
+MeshPPS pps(meshClock);
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.println("\n=== Pulse Per Second ===");
+
+    meshClock.begin();
+
+    // 1 Hz, 100 µs wide pulses; e.g. pps.begin(PPS_PIN, 10000, 1000) for 100 Hz
+    if (!pps.begin(PPS_PIN, 1000000, 100)) {
+        Serial.println("PPS output failed to start");
+    }
+}
+
+void loop() {
+    meshClock.loop();
+
+    static uint32_t lastReport = 0;
+    if (millis() - lastReport >= 5000) {
+        lastReport = millis();
+
+        Serial.printf("[PPS] %u pulses, %u missed - %s\n",
+                      pps.getPulses(), pps.getMissed(),
+                      meshClock.getSyncState() == SyncState::SYNCED ? "SYNCED" : "not synced");
+    }
+
+    delay(1);
+}
@@ -15,6 +15,7 @@
  */
 
 #include <ESPNowMeshClock.h>
+#include <MeshTicker.h>
 
 // Pin configuration
 #define LED_PIN LED_BUILTIN  // Usually GPIO 2 on most ESP32 boards
@@ -28,6 +29,17 @@ ESPNowMeshClock meshClock(
     15     // ±15% random variation (better collision avoidance)
 );
 
+// Coordinated action every 2 seconds of mesh time
+MeshTicker action(meshClock);
+uint64_t actionTick = 0;
+portMUX_TYPE actionLock = portMUX_INITIALIZER_UNLOCKED;  // 64-bit: not written in one go
+
+void onAction(uint64_t tick, void *arg) {
+    portENTER_CRITICAL(&actionLock);
+    actionTick = tick;
+    portEXIT_CRITICAL(&actionLock);
+}
+
 unsigned long lastLedUpdate = 0;
 bool ledState = false;
 
@@ -136,6 +148,7 @@ void setup() {
     
     // Initialize mesh clock
     meshClock.begin();
+    action.begin(2000000, onAction);
     
     Serial.println("Mesh clock initialized. Waiting for sync...\n");
 }
@@ -160,15 +173,17 @@ void loop() {
     // Print statistics periodically when synced
     printStatistics();
     
-    // Example: Coordinated action every 2 seconds
-    static uint32_t lastAction = 0;
-    uint32_t meshMs = meshClock.meshMillis();
+    // Example: Coordinated action every 2 seconds (ticks from the MeshTicker)
+    static uint64_t reportedTick = 0;
+    portENTER_CRITICAL(&actionLock);
+    uint64_t tick = actionTick;
+    portEXIT_CRITICAL(&actionLock);
     
-    if (meshMs - lastAction >= 2000) {
-        lastAction = meshMs;
+    if (tick != reportedTick) {
+        reportedTick = tick;
         
         if (currentState == SyncState::SYNCED) {
-            Serial.printf("⏱  Synchronized tick at mesh time: %u ms\n", meshMs);
+            Serial.printf("⏱  Synchronized tick at mesh time: %llu ms\n", tick * 2000);
         }
     }
     
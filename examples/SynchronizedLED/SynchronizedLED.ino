@@ -5,6 +5,8 @@
  * by using mesh time to coordinate LED patterns.
  * 
  * All devices in the mesh will blink their LEDs in perfect unison!
+ * A MeshTicker toggles the LED at each mesh time boundary (scheduleAt()
+ * underneath), so it does not depend on how often loop() runs.
  * 
  * Hardware:
  * - Built-in LED (or external LED on GPIO 2)
@@ -13,6 +15,7 @@
  */
 
 #include <ESPNowMeshClock.h>
+#include <MeshTicker.h>
 
 #define LED_PIN LED_BUILTIN
 
@@ -25,11 +28,19 @@ ESPNowMeshClock meshClock(
     20     // ±20% variation
 );
 
+#define BLINK_US 500000  // LED on for 500 ms, off for 500 ms
+
+// Square wave on the LED: HIGH on even 500 ms boundaries of mesh time, LOW
+// on odd ones. A clock step skips edges rather than replaying them, and
+// end() stops the toggles for good (no second chain when blinking resumes).
+MeshTicker blink(meshClock);
+
 void setup() {
     Serial.begin(115200);
     delay(1000);
     
     pinMode(LED_PIN, OUTPUT);
+    blink.setPin(LED_PIN);
     
     Serial.println("\n=== Synchronized LED Pattern Demo ===");
     Serial.println("All devices will blink in perfect sync!\n");
@@ -41,18 +52,18 @@ void loop() {
     meshClock.loop();
     
     SyncState state = meshClock.getSyncState();
+    static bool blinking = false;
     
     if (state == SyncState::SYNCED) {
-        // Get mesh time and create synchronized pattern
         uint64_t meshUs = meshClock.meshMicros();
-        
+
         // Pattern 1: Simple blink every 500ms
         // All devices will have LED ON/OFF at exactly the same time
-        uint32_t phase = (meshUs / 1000) % 1000;  // 0-999ms cycle
-        bool ledOn = phase < 500;
-        digitalWrite(LED_PIN, ledOn);
+        if (!blinking) {
+            blinking = blink.begin(BLINK_US);
+        }
         
-        // You can create more complex patterns:
+        // You can also poll mesh time for patterns (to the precision of loop()):
         /*
         // Pattern 2: Fast pulse every 2 seconds
         uint32_t cycle = (meshUs / 1000000) % 2;  // 0-1 (2 second cycle)
@@ -82,6 +93,11 @@ void loop() {
         }
         
     } else {
+        if (blinking) {
+            blink.end();
+            blinking = false;
+        }
+
         // Not synced - show waiting pattern
         static unsigned long lastBlink = 0;
         if (millis() - lastBlink >= 100) {
@@ -0,0 +1,691 @@
+/*
+ * ESPNowMeshClock - host-side discrete-event mesh simulator
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs many virtual nodes, each owning a real ESPNowMeshClock instance
+ * compiled from ../../src against the host stand-ins in ./stubs.
+ *
+ * Every node has its own crystal error (ppm), boot time and local clock.
+ * Frames sent with esp_now_send() are delivered to topology neighbours
+ * through handleReceive() after a per-link latency, or dropped.
+ * The global skew (max - min meshMicros() over all booted nodes) is
+ * sampled at a fixed period to derive convergence time and max skew.
+ *
+ * Any numeric option accepts a comma separated list; the simulator then
+ * runs the cartesian product and prints one CSV row per configuration.
+ */
+
+#include <ESPNowMeshClock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+struct SimConfig {
+    // Topology
+    int         nodes        = 50;
+    std::string topology     = "full";   // full | chain | ring | grid | random
+    double      radius       = 0.25;     // link range for "random" (unit square)
+
+    // Radio model
+    double      latencyUs    = 1000;     // mean one-way latency (stamp -> receive callback)
+    double      jitterUs     = 50;       // latency standard deviation
+    double      linkSpreadUs = 0;        // per-link mean latency offset, uniform in +/- linkSpreadUs
+    double      loss         = 0.02;     // per-link frame loss probability
+    int         badNodes     = 0;        // nodes whose transmissions suffer extra jitter
+    double      badJitterUs  = 800;      // extra latency standard deviation of bad nodes
+    double      rxDelayUs    = 0;        // arrival -> handleReceive() delay, uniform in [0, rxDelayUs]
+    std::string rxStamp      = "arrival"; // arrival: pass the arrival stamp, call: let handleReceive() stamp
+    double      collisionUs  = 0;        // frames heard by a node whose transmissions start this close collide (0: no collisions)
+    double      usPerByte    = 0;        // extra latency per frame byte (airtime; 8 = 1 Mbps)
+    double      txQueueUs    = 0;        // mean sender queueing delay (exponential, FIFO per node, same for all receivers of a frame)
+
+    // Application traffic
+    double      payloadHz    = 0;        // user frames per second and node, each carrying appendTrailer()
+    double      payloadBytes = 64;       // user payload size
+
+    // Oscillator model
+    double      driftPpm     = 20;       // crystal error drawn uniformly in +/- driftPpm
+    double      bootSpreadMs = 2000;     // nodes power up uniformly in [0, bootSpreadMs]
+
+    // ESPNowMeshClock constructor parameters
+    double      intervalMs   = 1000;
+    double      alpha        = 0.25;
+    double      largeStepUs  = 10000;
+    double      syncTimeoutMs = 5000;
+    double      variation    = 10;
+    double      freqGain     = 0;        // setFrequencyGain()
+    double      delayProbeMs = 0;        // setDelayMeasurement()
+    double      domain       = 0;        // setDomain()
+    double      packetVersion = 1;       // setPacketVersion()
+    double      maxIntervalMs = 0;       // setMaxInterval()
+    double      suppress     = 0;        // setSuppression()
+    double      slots        = 0;        // setSlots()
+    double      twoStep      = 0;        // setTwoStep() (send completions reach the library through handleSent())
+    std::string syncMode     = "forward"; // setSyncMode(): forward | grandmaster | average
+
+    // Run control
+    double      durationS    = 60;
+    double      loopMs       = 10;       // how often each node calls loop()
+    double      sampleMs     = 100;      // skew sampling period
+    double      thresholdUs  = 100;      // skew considered "converged"
+    double      killMasterS  = 0;        // power off the grandmaster (most advanced node in forward mode) at this time
+    uint64_t    seed         = 1;
+    std::string traceFile;               // optional per-sample CSV
+    std::string syncTraceFile;           // optional dumpTrace() of node 0 at the end of the run
+    std::string profileFile;             // optional per-node CSV (lag, hops, stratum)
+};
+
+// Print sink for dumpTrace()
+class FilePrint : public Print {
+public:
+    explicit FilePrint(FILE *f) : _f(f) {}
+    size_t write(const uint8_t *buf, size_t len) override { return fwrite(buf, 1, len, _f); }
+private:
+    FILE *_f;
+};
+
+struct SimResult {
+    double   convergenceS   = -1;   // time from last boot until skew stays <= threshold (-1: never)
+    double   steadyMaxSkewUs = 0;   // max skew once converged (or over the second half of the run)
+    double   meanSkewUs     = 0;    // mean skew over the same window
+    double   finalSkewUs    = 0;
+    double   meshRatePpm    = 0;    // mean mesh clock rate error vs true time
+    double   failoverS      = -1;   // --kill-master in grandmaster mode: until all live nodes follow one new master
+    uint64_t frames         = 0;    // esp_now_send() calls
+    uint64_t deliveries     = 0;    // handleReceive() calls
+    uint64_t collisions     = 0;    // deliveries lost to --collision-us
+    double   wallS          = 0;
+};
+
+class MeshSim;
+static MeshSim *g_sim = nullptr;
+
+class MeshSim {
+public:
+    explicit MeshSim(const SimConfig &cfg)
+        : _cfg(cfg), _rngTopo(cfg.seed), _rngRadio(cfg.seed * 7919 + 1), _rngLib(cfg.seed * 104729 + 2) {}
+
+    SimResult run();
+
+private:
+    struct Node {
+        std::unique_ptr<ESPNowMeshClock> clock;
+        uint8_t  mac[6];
+        double   ppm;
+        uint64_t bootUs;
+        bool     booted = false;
+        bool     down = false;   // powered off by --kill-master
+        bool     bad = false;
+        uint64_t txStartUs = 0;  // last frame left the queue (FIFO)
+        uint64_t sentUs = 0;     // last send completion
+        std::vector<uint32_t> neighbours;
+        double   leadSum = 0, leadMax = 0;  // mesh time behind the most advanced node, second half
+        uint32_t leadCount = 0;
+    };
+
+    struct Frame {
+        uint32_t sender;
+        std::vector<uint8_t> data;
+        uint64_t txUs;
+    };
+
+    enum EventType : uint8_t { EV_BOOT, EV_LOOP, EV_DELIVER, EV_RECEIVE, EV_KILL, EV_PAYLOAD, EV_SENT };
+
+    struct Event {
+        uint64_t  t;
+        uint64_t  seq;
+        uint32_t  node;
+        uint32_t  frame;
+        EventType type;
+        uint64_t  stamp;  // EV_RECEIVE: local clock at arrival
+        bool operator>(const Event &o) const { return t != o.t ? t > o.t : seq > o.seq; }
+    };
+
+    // Local clock of the node at true time t. libclock starts TIMG0 at 0xFF000000.
+    uint64_t _localMicros(const Node &n, uint64_t t) const {
+        double elapsed = (double)(t - n.bootUs);
+        return 0xFF000000ULL + (uint64_t)(elapsed * (1.0 + n.ppm * 1e-6));
+    }
+
+    void _push(uint64_t t, EventType type, uint32_t node, uint32_t frame = 0, uint64_t stamp = 0) {
+        _events.push(Event{t, _seq++, node, frame, type, stamp});
+    }
+
+    void _buildTopology();
+    bool _collides(uint32_t receiver, uint32_t frame);
+    void _send(const uint8_t *dest, const uint8_t *data, size_t len);
+    void _sample(SimResult &res, FILE *trace);
+    void _writeProfile();
+    void _receive(Node &n, uint32_t frame, uint64_t stamp);
+    void _killMaster();
+
+    static uint64_t _hookClock()                 { return g_sim->_localMicros(g_sim->_nodes[g_sim->_current], g_sim->_now); }
+    static void     _hookSend(const uint8_t *d, const uint8_t *p, size_t l) { g_sim->_send(d, p, l); }
+    static long     _hookRandom(long lo, long hi) {
+        return std::uniform_int_distribution<long>(lo, hi - 1)(g_sim->_rngLib);
+    }
+    static void     _hookMac(uint8_t *mac)       { memcpy(mac, g_sim->_nodes[g_sim->_current].mac, 6); }
+
+    // Fixed mean latency offset of the (undirected) link a-b, derived from a hash
+    double _linkOffsetUs(uint32_t a, uint32_t b) const {
+        if (_cfg.linkSpreadUs <= 0) return 0;
+        uint64_t h = ((uint64_t)std::min(a, b) << 32 | std::max(a, b)) ^ (_cfg.seed * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 33; h *= 0xFF51AFD7ED558CCDULL; h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ULL; h ^= h >> 33;
+        return ((double)(h >> 11) / (double)(1ULL << 53) * 2.0 - 1.0) * _cfg.linkSpreadUs;
+    }
+
+    SimConfig _cfg;
+    std::vector<Node>  _nodes;
+    std::vector<Frame> _frames;
+    std::vector<std::vector<bool>> _hears;  // _hears[a][b]: a is in range of b (only with --collision-us)
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _events;
+    uint64_t _seq = 0;
+    uint64_t _now = 0;
+    uint32_t _current = 0;
+    uint64_t _lastBootUs = 0;
+    uint64_t _killUs = 0;      // when --kill-master struck (0 = not yet)
+    uint32_t _killedId = 0;    // reference id of the node powered off
+    std::mt19937_64 _rngTopo, _rngRadio, _rngLib;
+
+    // Sampling state
+    uint64_t _lastBadUs = 0;
+    struct Sample {
+        uint64_t t;
+        double   skew;
+        double   meanMesh;
+    };
+    std::vector<Sample> _samples;
+    SimResult *_res = nullptr;
+};
+
+void MeshSim::_buildTopology() {
+    const int n = _cfg.nodes;
+    if (_cfg.collisionUs > 0) _hears.assign(n, std::vector<bool>(n, false));
+    auto link = [&](int a, int b) {
+        _nodes[a].neighbours.push_back(b);
+        _nodes[b].neighbours.push_back(a);
+        if (!_hears.empty()) _hears[a][b] = _hears[b][a] = true;
+    };
+
+    if (_cfg.topology == "full") {
+        for (int a = 0; a < n; a++)
+            for (int b = a + 1; b < n; b++) link(a, b);
+    } else if (_cfg.topology == "chain" || _cfg.topology == "ring") {
+        for (int a = 0; a + 1 < n; a++) link(a, a + 1);
+        if (_cfg.topology == "ring" && n > 2) link(n - 1, 0);
+    } else if (_cfg.topology == "grid") {
+        int w = (int)std::ceil(std::sqrt((double)n));
+        for (int a = 0; a < n; a++) {
+            if ((a % w) + 1 < w && a + 1 < n) link(a, a + 1);
+            if (a + w < n) link(a, a + w);
+        }
+    } else if (_cfg.topology == "random") {
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        std::vector<std::pair<double, double>> pos(n);
+        for (auto &p : pos) p = {u(_rngTopo), u(_rngTopo)};
+        for (int a = 0; a < n; a++)
+            for (int b = a + 1; b < n; b++)
+                if (std::hypot(pos[a].first - pos[b].first, pos[a].second - pos[b].second) <= _cfg.radius)
+                    link(a, b);
+    } else {
+        fprintf(stderr, "unknown topology '%s'\n", _cfg.topology.c_str());
+        exit(2);
+    }
+}
+
+void MeshSim::_send(const uint8_t *dest, const uint8_t *data, size_t len) {
+    static const uint8_t bcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    Node &src = _nodes[_current];
+
+    uint32_t id = (uint32_t)_frames.size();
+    _frames.push_back(Frame{_current, std::vector<uint8_t>(data, data + len), _now});
+    _res->frames++;
+
+    std::normal_distribution<double>       lat(_cfg.latencyUs, _cfg.jitterUs);
+    std::normal_distribution<double>       badLat(0.0, _cfg.badJitterUs);
+    std::uniform_real_distribution<double> drop(0.0, 1.0);
+    bool broadcast = memcmp(dest, bcast, 6) == 0;
+
+    // Time in the sender's transmit queue delays the frame for every receiver
+    uint64_t start = _now;
+    if (_cfg.txQueueUs > 0) {
+        start = std::max(_now + (uint64_t)std::exponential_distribution<double>(1.0 / _cfg.txQueueUs)(_rngRadio), src.txStartUs);
+        src.txStartUs = start;
+    }
+    // Send callback: MESHCLOCK_FOLLOWUP_DELAY_US before the mean arrival, in send order
+    if (_cfg.twoStep > 0) {
+        double done = _cfg.latencyUs + len * _cfg.usPerByte - MESHCLOCK_FOLLOWUP_DELAY_US;
+        src.sentUs = std::max(start + (uint64_t)std::max(0.0, done), src.sentUs);
+        _push(src.sentUs, EV_SENT, _current);
+    }
+
+    for (uint32_t nb : src.neighbours) {
+        if (!broadcast && memcmp(dest, _nodes[nb].mac, 6) != 0) continue;
+        if (drop(_rngRadio) < _cfg.loss) continue;
+        double l = lat(_rngRadio) + _linkOffsetUs(_current, nb) + len * _cfg.usPerByte;
+        if (src.bad) l += badLat(_rngRadio);
+        l = std::max(50.0, l);
+        _push(start + (uint64_t)l, EV_DELIVER, nb, id);
+    }
+}
+
+// Another frame the receiver can hear (or its own: half duplex) started
+// within --collision-us of this one. Frames are stored in send order, so
+// only the neighbourhood of this one is scanned.
+bool MeshSim::_collides(uint32_t receiver, uint32_t frame) {
+    if (_cfg.collisionUs <= 0) return false;
+    const Frame &f = _frames[frame];
+    uint64_t win = (uint64_t)_cfg.collisionUs;
+    auto clash = [&](const Frame &o) { return o.sender == receiver || _hears[receiver][o.sender]; };
+    for (uint32_t j = frame; j-- > 0 && _frames[j].txUs + win > f.txUs;) {
+        if (clash(_frames[j])) return true;
+    }
+    for (uint32_t j = frame + 1; j < _frames.size() && _frames[j].txUs < f.txUs + win; j++) {
+        if (clash(_frames[j])) return true;
+    }
+    return false;
+}
+
+// Hand a frame to the library, with the arrival stamp or letting it stamp the call
+void MeshSim::_receive(Node &n, uint32_t frame, uint64_t stamp) {
+    const Frame &f = _frames[frame];
+    const uint8_t *mac = _nodes[f.sender].mac;
+    int len = (int)f.data.size();
+    if (_cfg.rxStamp == "call") {
+        if (!n.clock->handleReceive(mac, f.data.data(), len)) n.clock->handleTrailer(mac, f.data.data(), len);
+    } else {
+        if (!n.clock->handleReceive(mac, f.data.data(), len, stamp)) n.clock->handleTrailer(mac, f.data.data(), len, stamp);
+    }
+    _res->deliveries++;
+}
+
+void MeshSim::_sample(SimResult &res, FILE *trace) {
+    uint64_t lo = UINT64_MAX, hi = 0;
+    double   sum = 0;
+    int      booted = 0, synced = 0, live = 0;
+    std::vector<uint64_t> mesh(_nodes.size(), 0);
+    std::map<uint32_t, int> references;  // grandmaster id -> followers
+
+    for (uint32_t i = 0; i < _nodes.size(); i++) {
+        Node &n = _nodes[i];
+        if (n.down) continue;
+        live++;
+        if (!n.booted) continue;
+        _current = i;
+        uint64_t m = mesh[i] = n.clock->meshMicros();
+        lo = std::min(lo, m);
+        hi = std::max(hi, m);
+        sum += (double)m;
+        booted++;
+        if (n.clock->getSyncState() != SyncState::ALONE) synced++;
+        references[n.clock->getReference()]++;
+    }
+    if (!booted) return;
+
+    double skew = (double)(hi - lo);
+    double mean = sum / booted;
+    bool   allUp = booted == live;
+
+    if (!allUp || synced != booted || skew > _cfg.thresholdUs) _lastBadUs = _now;
+    if (allUp) _samples.push_back(Sample{_now, skew, mean});
+    if (allUp && _now >= (uint64_t)(_cfg.durationS * 1e6) / 2) {
+        for (Node &n : _nodes) {
+            if (n.down) continue;
+            double lag = (double)(hi - mesh[&n - &_nodes[0]]);
+            n.leadSum += lag;
+            n.leadMax = std::max(n.leadMax, lag);
+            n.leadCount++;
+        }
+    }
+    res.finalSkewUs = skew;
+    if (_killUs && res.failoverS < 0 && _cfg.syncMode == "grandmaster" && allUp &&
+        references.size() == 1 && references.begin()->first != _killedId) {
+        res.failoverS = (_now - _killUs) / 1e6;
+    }
+
+    if (trace) fprintf(trace, "%.3f,%d,%d,%.1f\n", _now / 1e6, booted, synced, skew);
+}
+
+// Power off the node everybody follows: the elected grandmaster, or the most
+// advanced clock in forward-only mode. Convergence is then counted from here.
+void MeshSim::_killMaster() {
+    int victim = -1;
+    uint64_t lead = 0;
+    for (uint32_t i = 0; i < _nodes.size(); i++) {
+        Node &n = _nodes[i];
+        if (!n.booted || n.down) continue;
+        _current = i;
+        uint64_t m = n.clock->meshMicros();
+        if (n.clock->isGrandmaster()) { victim = i; break; }
+        if (victim < 0 || m > lead) { victim = i; lead = m; }
+    }
+    if (victim < 0) return;
+    _nodes[victim].down = true;
+    _lastBootUs = std::max(_lastBootUs, _now);
+    _killUs = _now;
+    _current = victim;
+    _killedId = _nodes[victim].clock->getReference();
+}
+
+// One line per node: hops from node 0 (position along a chain), time behind
+// the most advanced node over the second half of the run, final stratum
+void MeshSim::_writeProfile() {
+    FILE *f = fopen(_cfg.profileFile.c_str(), "w");
+    if (!f) return;
+    std::vector<int> hops(_nodes.size(), -1);
+    std::vector<uint32_t> queue{0};
+    hops[0] = 0;
+    for (size_t q = 0; q < queue.size(); q++) {
+        for (uint32_t nb : _nodes[queue[q]].neighbours) {
+            if (hops[nb] < 0) { hops[nb] = hops[queue[q]] + 1; queue.push_back(nb); }
+        }
+    }
+    fprintf(f, "node,hops,ppm,rate_ppm,stratum,mean_lag_us,max_lag_us\n");
+    for (uint32_t i = 0; i < _nodes.size(); i++) {
+        Node &n = _nodes[i];
+        if (!n.clock) continue;
+        fprintf(f, "%u,%d,%.2f,%.2f,%u,%.1f,%.1f\n", i, hops[i], n.ppm, n.clock->getFrequencyPpm(),
+                n.clock->getStratum(), n.leadCount ? n.leadSum / n.leadCount : 0.0, n.leadMax);
+    }
+    fclose(f);
+}
+
+SimResult MeshSim::run() {
+    SimResult res;
+    _res = &res;
+    g_sim = this;
+    g_simHooks.localMicros   = _hookClock;
+    g_simHooks.send          = _hookSend;
+    g_simHooks.random        = _hookRandom;
+    g_simHooks.macAddress    = _hookMac;
+
+    auto wall0 = std::chrono::steady_clock::now();
+
+    _nodes.resize(_cfg.nodes);
+    std::uniform_real_distribution<double> drift(-_cfg.driftPpm, _cfg.driftPpm);
+    std::uniform_real_distribution<double> boot(0.0, _cfg.bootSpreadMs * 1000.0);
+    for (uint32_t i = 0; i < _nodes.size(); i++) {
+        Node &n = _nodes[i];
+        uint8_t mac[6] = {0x24, 0x6F, 0x28, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        memcpy(n.mac, mac, 6);
+        n.ppm    = drift(_rngTopo);
+        n.bootUs = (uint64_t)boot(_rngTopo);
+        _lastBootUs = std::max(_lastBootUs, n.bootUs);
+        _push(n.bootUs, EV_BOOT, i);
+    }
+    _buildTopology();
+    if (_cfg.killMasterS > 0) _push((uint64_t)(_cfg.killMasterS * 1e6), EV_KILL, 0);
+    for (int b = 0; b < _cfg.badNodes && b < _cfg.nodes; b++) {
+        _nodes[std::uniform_int_distribution<int>(0, _cfg.nodes - 1)(_rngTopo)].bad = true;
+    }
+
+    FILE *trace = nullptr;
+    if (!_cfg.traceFile.empty()) {
+        trace = fopen(_cfg.traceFile.c_str(), "w");
+        if (trace) fprintf(trace, "t_s,booted,synced,skew_us\n");
+    }
+
+    const uint64_t endUs    = (uint64_t)(_cfg.durationS * 1e6);
+    const uint64_t loopUs   = std::max<uint64_t>(1, (uint64_t)(_cfg.loopMs * 1000));
+    const uint64_t sampleUs = std::max<uint64_t>(1, (uint64_t)(_cfg.sampleMs * 1000));
+    uint64_t nextSample = sampleUs;
+
+    while (!_events.empty() && _events.top().t <= endUs) {
+        Event ev = _events.top();
+        _events.pop();
+
+        while (nextSample <= ev.t) {
+            _now = nextSample;
+            _sample(res, trace);
+            nextSample += sampleUs;
+        }
+
+        _now = ev.t;
+        _current = ev.node;
+        Node &n = _nodes[ev.node];
+
+        switch (ev.type) {
+        case EV_BOOT:
+            n.booted = true;
+            n.clock.reset(new ESPNowMeshClock((uint16_t)_cfg.intervalMs, (float)_cfg.alpha,
+                                              (uint32_t)_cfg.largeStepUs, (uint32_t)_cfg.syncTimeoutMs,
+                                              (uint8_t)_cfg.variation, _hookClock));
+            n.clock->setDebugLog(g_simHooks.serialEnabled ? LOG_ALL : 0);
+            n.clock->setFrequencyGain((float)_cfg.freqGain);
+            n.clock->setDelayMeasurement((uint16_t)_cfg.delayProbeMs);
+            n.clock->setDomain((uint8_t)_cfg.domain);
+            n.clock->setPacketVersion((uint8_t)_cfg.packetVersion);
+            n.clock->setMaxInterval((uint16_t)_cfg.maxIntervalMs);
+            n.clock->setSuppression((uint8_t)_cfg.suppress);
+            n.clock->setSlots((uint8_t)_cfg.slots);
+            n.clock->setTwoStep(_cfg.twoStep > 0);
+            n.clock->setSyncMode(_cfg.syncMode == "grandmaster" ? SyncMode::GRANDMASTER :
+                                 _cfg.syncMode == "average" ? SyncMode::AVERAGE : SyncMode::FORWARD_ONLY);
+            n.clock->begin(false);
+            _push(_now + loopUs, EV_LOOP, ev.node);
+            if (_cfg.payloadHz > 0) {
+                _push(_now + (uint64_t)std::uniform_real_distribution<double>(0, 1e6 / _cfg.payloadHz)(_rngLib), EV_PAYLOAD, ev.node);
+            }
+            break;
+        case EV_PAYLOAD: {
+            // Application frame with the clock trailer, as the sketch would send it
+            if (n.down) break;
+            std::vector<uint8_t> buf((size_t)_cfg.payloadBytes + MESHCLOCK_TRAILER_MAX, 0xA5);
+            size_t len = n.clock->appendTrailer(buf.data(), (size_t)_cfg.payloadBytes, buf.size());
+            static const uint8_t bcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+            esp_now_send(bcast, buf.data(), len);
+            _push(_now + (uint64_t)(1e6 / _cfg.payloadHz), EV_PAYLOAD, ev.node);
+            break;
+        }
+        case EV_LOOP:
+            if (n.down) break;
+            n.clock->loop();
+            _push(_now + loopUs, EV_LOOP, ev.node);
+            break;
+        case EV_DELIVER: {
+            if (!n.booted || n.down) break;  // radio not up yet
+            if (_collides(ev.node, ev.frame)) {
+                _res->collisions++;
+                break;
+            }
+            uint64_t stamp = _localMicros(n, _now);
+            if (_cfg.rxDelayUs > 0) {
+                uint64_t delay = (uint64_t)std::uniform_real_distribution<double>(0.0, _cfg.rxDelayUs)(_rngRadio);
+                _push(_now + delay, EV_RECEIVE, ev.node, ev.frame, stamp);
+            } else {
+                _receive(n, ev.frame, stamp);
+            }
+            break;
+        }
+        case EV_RECEIVE:
+            if (!n.down) _receive(n, ev.frame, ev.stamp);
+            break;
+        case EV_KILL:
+            _killMaster();
+            break;
+        case EV_SENT:
+            if (!n.down) n.clock->handleSent();
+            break;
+        }
+    }
+    while (nextSample <= endUs) {
+        _now = nextSample;
+        _sample(res, trace);
+        nextSample += sampleUs;
+    }
+    if (trace) fclose(trace);
+    if (!_cfg.profileFile.empty()) _writeProfile();
+    if (!_cfg.syncTraceFile.empty() && _nodes[0].clock) {
+        FILE *f = fopen(_cfg.syncTraceFile.c_str(), "w");
+        if (f) {
+            FilePrint out(f);
+            _nodes[0].clock->dumpTrace(out);
+            fclose(f);
+        }
+    }
+
+    // Convergence: skew stayed under threshold from the last "bad" sample onwards
+    uint64_t windowStart;
+    if (!_samples.empty() && _lastBadUs < _samples.back().t) {
+        windowStart = _lastBadUs + sampleUs;
+        res.convergenceS = (double)(windowStart - std::min(windowStart, _lastBootUs)) / 1e6;
+    } else {
+        windowStart = _lastBootUs + (endUs - _lastBootUs) / 2;
+    }
+
+    // Skew statistics and mesh rate over the steady window
+    double sum = 0;
+    int    count = 0;
+    const Sample *first = nullptr, *last = nullptr;
+    for (auto &s : _samples) {
+        if (s.t < windowStart) continue;
+        if (!first) first = &s;
+        last = &s;
+        res.steadyMaxSkewUs = std::max(res.steadyMaxSkewUs, s.skew);
+        sum += s.skew;
+        count++;
+    }
+    res.meanSkewUs = count ? sum / count : 0;
+    if (first && last->t > first->t)
+        res.meshRatePpm = ((last->meanMesh - first->meanMesh) / (double)(last->t - first->t) - 1.0) * 1e6;
+
+    res.wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+    g_sim = nullptr;
+    return res;
+}
+
+/**************************************************************
+ *  Command line
+ **************************************************************/
+
+static void usage() {
+    printf(
+        "usage: meshsim [--option value]...\n"
+        "\n"
+        "Numeric options accept comma separated lists (swept as a cartesian product).\n"
+        "\n"
+        "Topology:  --nodes N  --topology full|chain|ring|grid|random  --radius R\n"
+        "Radio:     --latency-us US  --jitter-us US  --link-spread-us US  --loss P\n"
+        "           --collision-us US (transmissions starting this close collide at common receivers)\n"
+        "           --us-per-byte US (airtime added to latency)  --tx-queue-us US (mean sender queueing delay)\n"
+        "App:       --payload-hz HZ  --payload-bytes N (user frames carrying the clock trailer)\n"
+        "           --bad-nodes N  --bad-jitter-us US (extra jitter on N random senders)\n"
+        "           --rx-delay-us US (arrival -> handleReceive() delay, uniform)  --rx-stamp arrival|call\n"
+        "Clocks:    --drift-ppm PPM  --boot-spread-ms MS\n"
+        "Library:   --interval MS  --alpha A  --large-step US  --sync-timeout MS  --variation PCT\n"
+        "           --freq-gain G  --delay-probe-ms MS  --domain ID  --packet-version 1|2\n"
+        "           --max-interval MS  --suppress K  --slots N  --two-step 0|1\n"
+        "           --sync-mode forward|grandmaster|average\n"
+        "Run:       --duration S  --loop-ms MS  --sample-ms MS  --threshold-us US  --seed N\n"
+        "           --kill-master S (power off the grandmaster / most advanced node at S; convergence counts from there)\n"
+        "Output:    --trace FILE (per-sample skew CSV)  --sync-trace FILE (node 0 dumpTrace())  --profile FILE (per-node lag CSV)  --verbose (library Serial output, LOG_ALL)\n");
+}
+
+static std::vector<std::string> splitList(const std::string &s) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (true) {
+        size_t comma = s.find(',', start);
+        out.push_back(s.substr(start, comma - start));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return out;
+}
+
+static bool applyOption(SimConfig &c, const std::string &key, const std::string &v) {
+    const std::map<std::string, double *> numeric = {
+        {"latency-us", &c.latencyUs},     {"jitter-us", &c.jitterUs},       {"loss", &c.loss}, {"collision-us", &c.collisionUs}, {"us-per-byte", &c.usPerByte}, {"tx-queue-us", &c.txQueueUs},
+        {"payload-hz", &c.payloadHz}, {"payload-bytes", &c.payloadBytes},
+        {"link-spread-us", &c.linkSpreadUs}, {"delay-probe-ms", &c.delayProbeMs}, {"domain", &c.domain}, {"packet-version", &c.packetVersion}, {"max-interval", &c.maxIntervalMs}, {"suppress", &c.suppress}, {"slots", &c.slots}, {"two-step", &c.twoStep}, {"bad-jitter-us", &c.badJitterUs},
+        {"rx-delay-us", &c.rxDelayUs},
+        {"drift-ppm", &c.driftPpm},       {"boot-spread-ms", &c.bootSpreadMs}, {"radius", &c.radius},
+        {"interval", &c.intervalMs},      {"alpha", &c.alpha},              {"large-step", &c.largeStepUs},
+        {"sync-timeout", &c.syncTimeoutMs}, {"variation", &c.variation},    {"freq-gain", &c.freqGain},
+        {"duration", &c.durationS},       {"kill-master", &c.killMasterS},
+        {"loop-ms", &c.loopMs},           {"sample-ms", &c.sampleMs},       {"threshold-us", &c.thresholdUs},
+    };
+    auto it = numeric.find(key);
+    if (it != numeric.end()) { *it->second = atof(v.c_str()); return true; }
+    if (key == "nodes")    { c.nodes = atoi(v.c_str()); return true; }
+    if (key == "bad-nodes") { c.badNodes = atoi(v.c_str()); return true; }
+    if (key == "seed")     { c.seed = strtoull(v.c_str(), nullptr, 10); return true; }
+    if (key == "topology") { c.topology = v; return true; }
+    if (key == "rx-stamp") { c.rxStamp = v; return true; }
+    if (key == "sync-mode") { c.syncMode = v; return true; }
+    if (key == "trace")    { c.traceFile = v; return true; }
+    if (key == "sync-trace") { c.syncTraceFile = v; return true; }
+    if (key == "profile")  { c.profileFile = v; return true; }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    // Ordered list of (option, values) so the CSV columns follow the command line
+    std::vector<std::pair<std::string, std::vector<std::string>>> options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "-h" || a == "--help") { usage(); return 0; }
+        if (a == "--verbose") { g_simHooks.serialEnabled = true; continue; }
+        if (a.rfind("--", 0) != 0 || i + 1 >= argc) { usage(); return 2; }
+        std::string key = a.substr(2);
+        SimConfig probe;
+        if (!applyOption(probe, key, argv[i + 1])) {
+            fprintf(stderr, "unknown option --%s\n", key.c_str());
+            return 2;
+        }
+        options.emplace_back(key, splitList(argv[++i]));
+    }
+
+    // Expand the cartesian product of all swept options
+    std::vector<std::vector<std::string>> combos(1);
+    for (auto &opt : options) {
+        std::vector<std::vector<std::string>> next;
+        for (auto &c : combos)
+            for (auto &v : opt.second) {
+                next.push_back(c);
+                next.back().push_back(v);
+            }
+        combos.swap(next);
+    }
+
+    for (auto &opt : options) printf("%s,", opt.first.c_str());
+    printf("convergence_s,steady_max_skew_us,mean_skew_us,final_skew_us,mesh_rate_ppm,failover_s,frames,deliveries,collisions,wall_s\n");
+
+    for (auto &combo : combos) {
+        SimConfig cfg;
+        for (size_t k = 0; k < options.size(); k++) applyOption(cfg, options[k].first, combo[k]);
+
+        MeshSim sim(cfg);
+        SimResult r = sim.run();
+
+        for (auto &v : combo) printf("%s,", v.c_str());
+        printf("%.3f,%.1f,%.1f,%.1f,%.2f,%.1f,%llu,%llu,%llu,%.2f\n",
+               r.convergenceS, r.steadyMaxSkewUs, r.meanSkewUs, r.finalSkewUs, r.meshRatePpm, r.failoverS,
+               (unsigned long long)r.frames, (unsigned long long)r.deliveries, (unsigned long long)r.collisions, r.wallS);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Host stand-in for the Arduino-ESP32 core (simulator builds only).
+ *
+ * Only the handful of symbols used by ESPNowMeshClock and libclock are
+ * provided. Time, randomness and radio access are routed through
+ * SimHooks so the simulator can run many virtual nodes in one process.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <algorithm>
+#include "esp_idf_version.h"
+#include "sim_hooks.h"
+
+#define IRAM_ATTR
+#define LOW  0
+#define HIGH 1
+#define INPUT  0x01
+#define OUTPUT 0x03
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+static inline uint32_t xthal_get_ccount() { return 0; }
+
+// Single-threaded host: critical sections are no-ops
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)  ((void)(mux))
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+long random(long howsmall, long howbig);
+inline long random(long howbig) { return random(0, howbig); }
+uint32_t getCpuFrequencyMhz();
+
+// No GPIO on the host: pins are accepted and ignored, interrupts never fire
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+#define digitalPinToInterrupt(p) (p)
+inline void attachInterruptArg(uint8_t, void (*)(void *), void *, int) {}
+inline void detachInterrupt(uint8_t) {}
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t *buf, size_t len) = 0;
+    int printf(const char *fmt, ...);
+    size_t print(const char *s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t println(const char *s = "") { return print(s) + print("\n"); }
+};
+
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long) {}
+    size_t write(const uint8_t *buf, size_t len) override;
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+    const char *getChipModel() { return "HOST-SIM"; }
+    void restart();
+};
+extern EspClass ESP;
@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for the Arduino-ESP32 WiFi library (simulator builds only).
+ */
+
+#pragma once
+#include <Arduino.h>
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t) { return true; }
+    uint8_t *macAddress(uint8_t *mac) { g_simHooks.macAddress(mac); return mac; }
+};
+extern WiFiClass WiFi;
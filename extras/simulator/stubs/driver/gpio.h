@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for ESP-IDF's driver/gpio.h (simulator builds only).
+ */
+
+#pragma once
+#include <stdint.h>
+#include "esp_now.h"
+
+typedef int gpio_num_t;
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
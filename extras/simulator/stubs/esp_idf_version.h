@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for ESP-IDF's esp_idf_version.h (simulator builds only).
+ * Override SIM_IDF_MAJOR on the compiler command line to build the
+ * pre-5.0 receive callback signature.
+ */
+
+#pragma once
+
+#ifndef SIM_IDF_MAJOR
+    #define SIM_IDF_MAJOR 5
+#endif
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(SIM_IDF_MAJOR, 1, 0)
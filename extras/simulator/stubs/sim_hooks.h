@@ -0,0 +1,21 @@
+/*
+ * Glue between the host stand-ins and the simulator.
+ *
+ * Every stubbed platform call that depends on "which node is running"
+ * (local time, radio transmit, PRNG) goes through these hooks. The
+ * simulator points them at the node it is currently executing.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+struct SimHooks {
+    uint64_t (*localMicros)();                                           // local clock of the running node
+    void     (*send)(const uint8_t *dest, const uint8_t *data, size_t len); // esp_now_send()
+    long     (*random)(long howsmall, long howbig);                      // Arduino random()
+    void     (*macAddress)(uint8_t *mac);                                // WiFi.macAddress()
+    bool     serialEnabled;                                              // forward Serial output to stdout
+};
+
+extern SimHooks g_simHooks;
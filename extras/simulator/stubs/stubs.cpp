@@ -0,0 +1,87 @@
+/*
+ * Host implementations of the stubbed Arduino / ESP-IDF calls.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_timer.h>
+#include <driver/gptimer.h>
+#include <driver/gpio.h>
+
+SimHooks g_simHooks = { nullptr, nullptr, nullptr, nullptr, false };
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+unsigned long millis() { return (unsigned long)(g_simHooks.localMicros() / 1000); }
+unsigned long micros() { return (unsigned long)g_simHooks.localMicros(); }
+void delay(uint32_t) {}
+void delayMicroseconds(uint32_t) {}
+uint32_t getCpuFrequencyMhz() { return 240; }
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) return howsmall;
+    return g_simHooks.random(howsmall, howbig);
+}
+
+int Print::printf(const char *fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return n;
+    return (int)write((const uint8_t*)buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+    return g_simHooks.serialEnabled ? fwrite(buf, 1, len, stdout) : 0;
+}
+
+void EspClass::restart() {
+    fprintf(stderr, "[sim] ESP.restart() called, aborting\n");
+    abort();
+}
+
+// libclock hardware init is never needed: every simulated node supplies its own ClockFn
+void fastinit() {}
+
+esp_err_t esp_now_init() { return ESP_OK; }
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t) { return ESP_OK; }
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t) { return ESP_OK; }
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *) { return ESP_OK; }
+bool esp_now_is_peer_exist(const uint8_t *) { return true; }
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+    if (len > ESP_NOW_MAX_DATA_LEN) return ESP_FAIL;
+    g_simHooks.send(peer_addr, data, len);
+    return ESP_OK;
+}
+
+// Timers are created but never fire (scheduleAt() is not simulated)
+esp_err_t esp_timer_create(const esp_timer_create_args_t *, esp_timer_handle_t *out_handle) {
+    static int dummy;
+    *out_handle = (esp_timer_handle_t)&dummy;
+    return ESP_OK;
+}
+esp_err_t esp_timer_start_once(esp_timer_handle_t, uint64_t) { return ESP_OK; }
+esp_err_t esp_timer_stop(esp_timer_handle_t) { return ESP_OK; }
+esp_err_t esp_timer_delete(esp_timer_handle_t) { return ESP_OK; }
+
+// Hardware timers and GPIOs: accepted, nothing happens
+esp_err_t gptimer_new_timer(const gptimer_config_t *, gptimer_handle_t *ret_timer) {
+    static int dummy;
+    *ret_timer = (gptimer_handle_t)&dummy;
+    return ESP_OK;
+}
+esp_err_t gptimer_del_timer(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t, const gptimer_event_callbacks_t *, void *) { return ESP_OK; }
+esp_err_t gptimer_enable(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_disable(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_start(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_stop(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_get_raw_count(gptimer_handle_t, uint64_t *value) { *value = 0; return ESP_OK; }
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t, const gptimer_alarm_config_t *) { return ESP_OK; }
+esp_err_t gpio_set_level(gpio_num_t, uint32_t) { return ESP_OK; }
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Decode an ESPNowMeshClock sync trace (dumpTrace() output) into CSV or a plot.
+
+The input is a captured serial log (or the simulator's --sync-trace file);
+lines outside the MCTRACE ... MCTRACE END block are ignored, so a full
+monitor capture can be passed as is. If the log holds several dumps, the
+last one is decoded unless --all is given.
+
+    python3 meshtrace.py capture.log > trace.csv
+    python3 meshtrace.py capture.log --plot trace.png
+
+Plotting needs matplotlib; CSV output has no dependencies.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+# Must match MeshClockTraceEvent in src/ESPNowMeshClock.h
+EVENT_FORMAT = "<IiiBBBB"
+EVENT_SIZE = struct.calcsize(EVENT_FORMAT)
+
+EVENTS = ["step", "behind", "slew", "none", "outlier", "low_q", "untracked", "stratum", "back",
+          "not_parent"]
+STATES = ["alone", "synced", "lost"]
+
+
+def parse_dumps(lines):
+    """Yield (peers, events) for every complete MCTRACE block."""
+    peers, events, inside = {}, [], False
+    for raw in lines:
+        line = raw.strip()
+        if line.startswith("MCTRACE END"):
+            if inside:
+                yield peers, events
+            inside = False
+        elif line.startswith("MCTRACE "):
+            fields = line.split()
+            if len(fields) < 2 or fields[1] != "1":
+                sys.exit("unsupported trace version: " + line)
+            peers, events, inside = {}, [], True
+        elif not inside:
+            continue
+        elif line.startswith("MCPEER "):
+            _, slot, mac = line.split()
+            peers[int(slot)] = mac
+        elif len(line) == 2 * EVENT_SIZE:
+            events.append(struct.unpack(EVENT_FORMAT, bytes.fromhex(line)))
+
+
+def decode(peers, events):
+    """Turn raw events into rows, unwrapping the 32-bit microsecond stamps."""
+    rows, base, last = [], 0, None
+    for micros, delta, step, peer, event, state, quality in events:
+        if last is not None and micros < last:
+            base += 1 << 32
+        last = micros
+        rows.append({
+            "t_us": base + micros,
+            "peer": "" if peer == 0xFF else peer,
+            "mac": "" if peer == 0xFF else peers.get(peer, "?"),
+            "event": EVENTS[event] if event < len(EVENTS) else event,
+            "delta_us": delta,
+            "step_us": step,
+            "state": STATES[state] if state < len(STATES) else state,
+            "quality": quality,
+        })
+    if rows:
+        t0 = rows[0]["t_us"]
+        for r in rows:
+            r["t_s"] = (r["t_us"] - t0) / 1e6
+    return rows
+
+
+def write_csv(rows, out):
+    fields = ["t_s", "t_us", "peer", "mac", "event", "delta_us", "step_us", "state", "quality"]
+    w = csv.DictWriter(out, fieldnames=fields, lineterminator="\n")
+    w.writeheader()
+    w.writerows(rows)
+
+
+def plot(rows, path):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        sys.exit("--plot needs matplotlib (pip install matplotlib)")
+
+    fig, (ax_delta, ax_step) = plt.subplots(2, 1, sharex=True, figsize=(11, 7))
+    for name in EVENTS:
+        sel = [r for r in rows if r["event"] == name]
+        if sel:
+            ax_delta.scatter([r["t_s"] for r in sel], [r["delta_us"] for r in sel], s=6, label=name)
+    ax_delta.set_ylabel("delta (us)")
+    ax_delta.set_yscale("symlog", linthresh=100)
+    ax_delta.legend(loc="upper right", fontsize="small", markerscale=2)
+    ax_delta.grid(True, alpha=0.3)
+
+    steps = [r for r in rows if r["step_us"]]
+    ax_step.step([r["t_s"] for r in steps], [r["step_us"] for r in steps], where="post")
+    ax_step.set_ylabel("step applied (us)")
+    ax_step.set_yscale("symlog", linthresh=100)
+    ax_step.set_xlabel("time since first event (s)")
+    ax_step.grid(True, alpha=0.3)
+
+    fig.tight_layout()
+    fig.savefig(path, dpi=120)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode an ESPNowMeshClock dumpTrace() capture")
+    ap.add_argument("log", nargs="?", default="-", help="serial capture (default: stdin)")
+    ap.add_argument("--plot", metavar="PNG", help="write a delta/step plot instead of CSV")
+    ap.add_argument("--all", action="store_true", help="decode every dump in the log, not just the last")
+    args = ap.parse_args()
+
+    src = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+    dumps = list(parse_dumps(src))
+    if not dumps:
+        sys.exit("no MCTRACE block found")
+    if not args.all:
+        dumps = dumps[-1:]
+
+    rows = []
+    for peers, events in dumps:
+        rows.extend(decode(peers, events))
+
+    if args.plot:
+        plot(rows, args.plot)
+    else:
+        write_csv(rows, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
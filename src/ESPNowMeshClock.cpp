@@ -19,16 +19,95 @@
 #include "ESPNowMeshClock.h"
 
 ESPNowMeshClock* ESPNowMeshClock::_instance = nullptr;
+ESPNowMeshClock* ESPNowMeshClock::_domains[MESHCLOCK_MAX_DOMAINS] = {};
 
-static uint64_t defaultClockFn() {
+static uint64_t IRAM_ATTR defaultClockFn() {
     return fastmicros64_isr();
 }
 
+// Little-endian packing of wire fields (timestamps are 56-bit, 7 bytes)
+static void packLE(uint8_t *dst, uint64_t value, int bytes) {
+    for(int i = 0; i < bytes; i++) {
+        dst[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint64_t unpackLE(const uint8_t *src, int bytes) {
+    uint64_t value = 0;
+    for(int i = 0; i < bytes; i++) {
+        value |= ((uint64_t)src[i]) << (i * 8);
+    }
+    return value;
+}
+
+// 32-bit finalizer (MurmurHash3): every input bit reaches every output bit,
+// so MACs that only differ in one byte still spread
+static uint32_t mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+static const uint64_t MASK56 = (1ULL << 56) - 1;
+
+static_assert((MESHCLOCK_MAX_PEERS & (MESHCLOCK_MAX_PEERS - 1)) == 0, "MESHCLOCK_MAX_PEERS must be a power of two");
+static_assert((MESHCLOCK_RX_QUEUE & (MESHCLOCK_RX_QUEUE - 1)) == 0, "MESHCLOCK_RX_QUEUE must be a power of two");
+static_assert(sizeof(MeshClockDelayResp) <= MESHCLOCK_RX_PACKET, "MESHCLOCK_RX_PACKET too small");
+static_assert((MESHCLOCK_TRACE_SIZE & (MESHCLOCK_TRACE_SIZE - 1)) == 0, "MESHCLOCK_TRACE_SIZE must be a power of two");
+static_assert(sizeof(MeshClockFrameHeader) <= MESHCLOCK_RX_PACKET, "MESHCLOCK_RX_PACKET too small");
+static_assert(sizeof(MeshClockTraceEvent) == 16, "MeshClockTraceEvent layout changed, update extras/tracedecode");
+
+static int32_t saturate32(int64_t v) {
+    return v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : (int32_t)v);
+}
+
+// Median of a small array (sorted in place)
+static int32_t median(int32_t *v, int n) {
+    for(int i = 1; i < n; i++) {
+        int32_t x = v[i];
+        int j = i - 1;
+        while(j >= 0 && v[j] > x) { v[j + 1] = v[j]; j--; }
+        v[j + 1] = x;
+    }
+    return (n & 1) ? v[n / 2] : (int32_t)(((int64_t)v[n / 2 - 1] + v[n / 2]) / 2);
+}
+
 ESPNowMeshClock::ESPNowMeshClock(uint16_t interval_ms, float slew_alpha, uint32_t large_step_us, uint32_t sync_timeout_ms, uint8_t random_variation_percent, ClockFn clkfn)
     : _interval(interval_ms), _alpha(slew_alpha), _largeStep(large_step_us), _syncTimeout(sync_timeout_ms), _randomVariation(random_variation_percent),
-      _clock(clkfn ? clkfn : defaultClockFn), _offset(0), _synced(false), _lastSync(0), _lastBroadcast(0), _nextBroadcastDelay(0), _userCallback(nullptr), _debugLog(LOG_SYNC)
+      _clock(clkfn ? clkfn : defaultClockFn), _offset(0), _rate(0), _rateAnchor(0), _stepTotal(0), _slewRate(0), _slewLeft(0), _slewEnd(0), _tbSeq(0),
+      _eventCount(0), _eventGen(0), _alarm(nullptr),
+      _freqGain(0), _driftSum(0), _driftCount(0), _refJitter(0), _untracked(0), _neighbours(0),
+      _synced(false), _lastSync(0), _lastBroadcast(0), _nextBroadcastDelay(0),
+      _period(interval_ms), _maxInterval(0), _unsettled(false), _samples(0), _noisy(0), _suppress(0), _consistent(0), _slots(0), _slot(0), _nextSlot(0),
+      _trailers(0), _batching(false),
+      _twoStep(false), _txSent(0), _txDone(0), _txMark(0), _txSeq(0), _txArmed(false), _txReady(false), _txMesh(0),
+      _userCallback(nullptr), _debugLog(LOG_SYNC),
+      _delayPeriod(0), _lastDelayProbe(0), _probeIndex(0), _probeT1(0), _meanDelay(0),
+      _rxHead(0), _rxTail(0), _rxDropped(0),
+      _domain(0), _packetVersion(1), _seq(0), _stratum(0), _reference(0),
+      _mode(SyncMode::FORWARD_ONLY), _priority(128), _masterPriority(128), _masterSeq(0), _masterHeard(0), _deadMaster(0), _deadSeq(0), _deadAt(0), _parent(nullptr)
 {
-    _instance = this;
+    memset(_mac, 0, sizeof(_mac));
+    memset(_peers, 0, sizeof(_peers));
+    memset(_tb, 0, sizeof(_tb));
+    #if MESHCLOCK_TRACE_SIZE > 0
+    memset(_trace, 0, sizeof(_trace));
+    _traceCount = 0;
+    #endif
+}
+
+ESPNowMeshClock::~ESPNowMeshClock() {
+    for(int i = 0; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        if(_domains[i] == this) _domains[i] = nullptr;
+    }
+    if(_instance == this) _instance = nullptr;
+    if(_alarm) {
+        esp_timer_stop(_alarm);
+        esp_timer_delete(_alarm);
+    }
 }
 
 void ESPNowMeshClock::begin(bool registerCallback) {
@@ -66,28 +145,178 @@ void ESPNowMeshClock::begin(bool registerCallback) {
     }
 
     WiFi.mode(WIFI_STA);
+    WiFi.macAddress(_mac);  // Needed to recognize delay measurement packets addressed to us
+    _reference = _selfId();
+    setSlots(_slots);  // Hash the real MAC
     if(esp_now_init() != ESP_OK) {
         Serial.println("[ERR] ESP-NOW INIT FAILED");
         delay(1000); ESP.restart();
     }
 
+    // Register this domain so packets received by any instance reach it
+    int slot = -1;
+    for(int i = 0; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        if(_domains[i] && _domains[i]->_domain == _domain) { slot = i; break; }
+        if(!_domains[i] && slot < 0) slot = i;
+    }
+    if(slot >= 0) _domains[slot] = this;
+    else Serial.printf("[ESPNowMeshClock] Too many domains (MESHCLOCK_MAX_DOMAINS = %d)\r\n", MESHCLOCK_MAX_DOMAINS);
+
     // Only register callback if requested (allows user to handle ESP-NOW manually)
     if (registerCallback) {
+        _instance = this;
         esp_now_register_recv_cb(_onReceive);
     }
 
+    // Send completions reach every two-step domain, whichever instance
+    // registered the callbacks and in whatever order they were started
+    bool twoStep = false;
+    for(int i = 0; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        if(_domains[i] && _domains[i]->_twoStep) twoStep = true;
+    }
+    if(_instance && twoStep) esp_now_register_send_cb(_onSent);
+
     // Add broadcast peer
     esp_now_peer_info_t peerInfo = {};
     memcpy(peerInfo.peer_addr, bcastAddr, 6);
     peerInfo.channel = 0;
     peerInfo.encrypt = false;
     if(!esp_now_is_peer_exist(bcastAddr)) esp_now_add_peer(&peerInfo);
+
+    // scheduleAt() timer: created here, before any task can schedule, so
+    // concurrent first calls never race to create it
+    if(!_alarm) {
+        esp_timer_create_args_t args = {};
+        args.callback = _onAlarm;
+        args.arg = this;
+        args.name = "meshclock";
+        if(esp_timer_create(&args, &_alarm) != ESP_OK) _alarm = nullptr;
+    }
     Serial.println("[ESPNowMeshClock] Started.");
 }
 
-uint64_t ESPNowMeshClock::meshMicros() { return _clock() + _offset; }
+uint64_t IRAM_ATTR ESPNowMeshClock::meshMicros() {
+    return _meshAt(_clock());
+}
 uint32_t ESPNowMeshClock::meshMillis() { return meshMicros() / 1000; }
 
+float ESPNowMeshClock::getFrequencyPpm() {
+    return _rate * (1e6f / 4294967296.0f);
+}
+
+// Seqlock read of the published time base: lock-free, never blocks on a
+// writer, safe from any task on either core and from ISRs. Writers fill the
+// buffer readers are not using, so a retry only happens when two updates land
+// during one read.
+uint64_t IRAM_ATTR ESPNowMeshClock::_meshAt(uint64_t localMicros) {
+    MeshClockTimebase tb;
+    uint32_t seq;
+    do {
+        seq = _tbSeq;
+        __sync_synchronize();
+        tb = _tb[seq & 1];
+        __sync_synchronize();
+    } while(seq != _tbSeq);
+
+    int64_t elapsed = (int64_t)(localMicros - tb.anchor);
+    return localMicros + tb.offset + ((elapsed * tb.rate) >> 32);
+}
+
+// Inverse of _meshAt() on the current time base: the local time at which
+// mesh time reaches meshMicros. First order in the rate, which is exact to
+// well under a microsecond within MESHCLOCK_ALARM_MAX_US of the anchor.
+uint64_t ESPNowMeshClock::_localAt(uint64_t meshMicros) {
+    MeshClockTimebase tb;
+    uint32_t seq;
+    do {
+        seq = _tbSeq;
+        __sync_synchronize();
+        tb = _tb[seq & 1];
+        __sync_synchronize();
+    } while(seq != _tbSeq);
+
+    int64_t elapsed = (int64_t)(meshMicros - tb.offset - tb.anchor);
+    return tb.anchor + elapsed - ((elapsed * tb.rate) >> 32);
+}
+
+// Copy the working offset/rate into the spare buffer, then flip. Caller holds _tbLock.
+void ESPNowMeshClock::_publish() {
+    MeshClockTimebase &tb = _tb[(_tbSeq + 1) & 1];
+    tb.offset = _offset;
+    tb.anchor = _rateAnchor;
+    tb.rate = _rate + _slewRate;
+    __sync_synchronize();
+    _tbSeq = _tbSeq + 1;
+}
+
+// Fold the rate correction accumulated since _rateAnchor into _offset,
+// keeping elapsed * _rate well inside 64 bits, and switch to a new rate.
+// The share of a backward slew applied meanwhile counts as a step; once it
+// is absorbed (or overshot, by up to a loop() period: made up with a forward
+// step) the slew ends. reproject false leaves the scheduler alarm to a caller
+// that changes the time base further.
+void ESPNowMeshClock::_rebase(uint64_t localMicros, int32_t rate, bool reproject) {
+    portENTER_CRITICAL(&_tbLock);
+    int64_t elapsed = (int64_t)(localMicros - _rateAnchor);
+    _offset += (elapsed * _rate) >> 32;
+    if(_slewRate) {
+        int64_t slewed = (elapsed * _slewRate) >> 32;
+        _offset += slewed;
+        _stepTotal += slewed;
+        _slewLeft -= slewed;
+        if(_slewLeft >= 0 || (int64_t)(localMicros - _slewEnd) >= 0) {
+            if(_slewLeft > 0) {
+                _offset += _slewLeft;
+                _stepTotal += _slewLeft;
+            }
+            _slewLeft = 0;
+            _slewRate = 0;
+        }
+    }
+    _rateAnchor = localMicros;
+    _rate = rate;
+    _publish();
+    portEXIT_CRITICAL(&_tbLock);
+    if(reproject) _reproject();
+}
+
+// Apply a backward correction without going backward: run ppm slower until
+// it is absorbed. Replaces any pending one (0 just cancels it): in
+// grandmaster mode each sample measures the whole remaining offset, in
+// average mode the caller adds what is still pending.
+void ESPNowMeshClock::_amortize(int64_t amount, uint32_t ppm) {
+    if(!amount && !_slewRate) return;
+    uint64_t now = _clock();
+    _rebase(now, _rate, false);
+    portENTER_CRITICAL(&_tbLock);
+    _slewLeft = amount < 0 ? amount : 0;
+    _slewRate = amount < 0 ? -(int32_t)(ppm * 4294.967296) : 0;
+    _slewEnd = now + (uint64_t)(-_slewLeft) * 1000000 / ppm;
+    _publish();
+    portEXIT_CRITICAL(&_tbLock);
+    _reproject();
+}
+
+// Step total as of localMicros, including the share of a running slew
+int64_t ESPNowMeshClock::_steps(uint64_t localMicros) {
+    return _stepTotal + (((int64_t)(localMicros - _rateAnchor) * _slewRate) >> 32);
+}
+
+// Move mesh time (forward, or backward at the first sync in grandmaster mode)
+void ESPNowMeshClock::_step(int64_t step) {
+    portENTER_CRITICAL(&_tbLock);
+    _offset += step;
+    _stepTotal += step;
+    _publish();
+    portEXIT_CRITICAL(&_tbLock);
+    _reproject();
+}
+
+// The time base changed: the armed timer was aimed with the old one
+void ESPNowMeshClock::_reproject() {
+    if(_eventCount) _armAlarm();
+}
+
 SyncState ESPNowMeshClock::getSyncState() {
     if (!_synced) {
         return SyncState::ALONE;
@@ -99,105 +328,933 @@ SyncState ESPNowMeshClock::getSyncState() {
     return SyncState::SYNCED;
 }
 
-bool ESPNowMeshClock::handleReceive(const uint8_t *mac, const uint8_t *data, int len) {
+bool IRAM_ATTR ESPNowMeshClock::handleReceive(const uint8_t *mac, const uint8_t *data, int len) {
+    return handleReceive(mac, data, len, _clock());
+}
+
+// "MCK" sync (10 bytes, or 14 with step total), "MCV" versioned frame, "MCQ" / "MCR" delay measurement
+static bool IRAM_ATTR isClockPacket(const uint8_t *data, int len) {
+    if(len < 3 || data[0] != MESHCLOCK_MAGIC_0 || data[1] != MESHCLOCK_MAGIC_1) return false;
+    return (data[2] == MESHCLOCK_MAGIC_2 && (len == sizeof(MeshClockPacket) || len == sizeof(MeshClockPacketExt))) ||
+           (data[2] == MESHCLOCK_MAGIC_FRAME && len >= (int)sizeof(MeshClockFrameHeader)) ||
+           (data[2] == MESHCLOCK_MAGIC_DELAY_REQ && len == sizeof(MeshClockDelayReq)) ||
+           (data[2] == MESHCLOCK_MAGIC_DELAY_RESP && len == sizeof(MeshClockDelayResp)) ||
+           (data[2] == MESHCLOCK_MAGIC_FOLLOW_UP && len == sizeof(MeshClockFollowUp));
+}
+
+// Runs in the WiFi task (or the user's receive callback): recognize the packet,
+// queue it with its arrival stamp. No logging, no locking, bounded time.
+bool IRAM_ATTR ESPNowMeshClock::handleReceive(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros) {
+    return _receive(mac, data, len, rxMicros, MeshClockCarrier::FRAME, 0);
+}
+
+bool IRAM_ATTR ESPNowMeshClock::_receive(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros, MeshClockCarrier carrier, uint16_t airtime) {
+    // "MCB": each record goes to its domain, read in place
+    MeshClockBatch batch;
+    if(batch.parse(data, len)) {
+        uint8_t domain;
+        const uint8_t *packet;
+        int n;
+        while(batch.next(domain, packet, n)) {
+            if(!isClockPacket(packet, n)) continue;
+            ESPNowMeshClock *target = domain == _domain ? this : _lookup(domain);
+            // The sender stamped each record for the rest of the frame (see _broadcastBatch())
+            uint16_t recordAirtime = min((len - n) * MESHCLOCK_US_PER_BYTE, 0xFFFF);
+            if(target) target->_enqueue(mac, packet, n, rxMicros, MeshClockCarrier::BATCH, recordAirtime);
+        }
+        return true;
+    }
+
+    // Unwrap "MCD" + domain id
+    uint8_t domain = 0;
+    if(len > (int)sizeof(MeshClockDomainHeader) && data[0] == MESHCLOCK_MAGIC_0 && data[1] == MESHCLOCK_MAGIC_1 &&
+       data[2] == MESHCLOCK_MAGIC_DOMAIN) {
+        domain = ((const MeshClockDomainHeader*)data)->domain;
+        data += sizeof(MeshClockDomainHeader);
+        len -= sizeof(MeshClockDomainHeader);
+    }
+    if(!isClockPacket(data, len)) return false;
+
+    ESPNowMeshClock *target = domain == _domain ? this : _lookup(domain);
+    if(target) target->_enqueue(mac, data, len, rxMicros, carrier, airtime);
+    return true;  // Packet was handled (dropped if its domain does not run here)
+}
+
+int IRAM_ATTR ESPNowMeshClock::handleTrailer(const uint8_t *mac, const uint8_t *data, int len) {
+    return handleTrailer(mac, data, len, _clock());
+}
+
+// Same context and bounds as handleReceive(): the trailer is checked from
+// the end and queued like a clock packet; anything else is left alone
+int IRAM_ATTR ESPNowMeshClock::handleTrailer(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros) {
+    if(len < 4 || data[len - 3] != MESHCLOCK_MAGIC_0 || data[len - 2] != MESHCLOCK_MAGIC_1 ||
+       data[len - 1] != MESHCLOCK_MAGIC_TRAILER) return len;
+    int n = data[len - 4];
+    // The sender stamped for the payload in front (and the 4 bytes behind)
+    uint16_t airtime = min((len - n) * MESHCLOCK_US_PER_BYTE, 0xFFFF);
+    if(n > len - 4 || !_receive(mac, data + len - 4 - n, n, rxMicros, MeshClockCarrier::TRAILER, airtime)) return len;
+    return len - 4 - n;
+}
+
+bool IRAM_ATTR MeshClockBatch::parse(const uint8_t *frame, int frameLen) {
+    data = frame;
+    len = frameLen;
+    pos = 3;
+    return len > 3 && data[0] == MESHCLOCK_MAGIC_0 && data[1] == MESHCLOCK_MAGIC_1 && data[2] == MESHCLOCK_MAGIC_BATCH;
+}
+
+bool IRAM_ATTR MeshClockBatch::next(uint8_t &domain, const uint8_t *&packet, int &packetLen) {
+    if(pos + 2 > len || pos + 2 + data[pos + 1] > len) return false;
+    domain = data[pos];
+    packetLen = data[pos + 1];
+    packet = data + pos + 2;
+    pos += 2 + packetLen;
+    return true;
+}
+
+ESPNowMeshClock* IRAM_ATTR ESPNowMeshClock::_lookup(uint8_t domain) {
+    for(int i = 0; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        ESPNowMeshClock *clk = _domains[i];
+        if(clk && clk->_domain == domain) return clk;
+    }
+    return nullptr;
+}
+
+void IRAM_ATTR ESPNowMeshClock::_enqueue(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros, MeshClockCarrier carrier, uint16_t airtime) {
+    uint16_t head = _rxHead;
+    if((uint16_t)(head - _rxTail) >= MESHCLOCK_RX_QUEUE) {
+        _rxDropped = _rxDropped + 1;
+        return;
+    }
+    MeshClockRx &rx = _rx[head & (MESHCLOCK_RX_QUEUE - 1)];
+    rx.rxMicros = rxMicros;
+    rx.carrier = carrier;
+    rx.airtime = airtime;
+    memcpy(rx.mac, mac, 6);
+    rx.len = len < MESHCLOCK_RX_PACKET ? len : MESHCLOCK_RX_PACKET;
+    memcpy(rx.data, data, rx.len);
+    __sync_synchronize();
+    _rxHead = head + 1;
+}
+
+// Apply one queued packet (loop() context)
+void ESPNowMeshClock::_process(const MeshClockRx &rx) {
+    const uint8_t *mac = rx.mac;
+    const uint8_t *data = rx.data;
+    int len = rx.len;
+
     // Log all received packets for debugging
-    if(_debugLog & LOG_RX) {
+    if(_logs(LOG_RX)) {
         Serial.printf("[MeshClock RX] Received %d bytes from %02X:%02X:%02X:%02X:%02X:%02X\r\n",
                       len, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
     }
-    
-    // Check if this is a mesh clock packet (must be exactly 10 bytes)
-    if(len != sizeof(MeshClockPacket)) {
-        if(_debugLog & LOG_RX) {
-            Serial.printf("[MeshClock RX] Discarded: Wrong size (expected %d bytes)\r\n", sizeof(MeshClockPacket));
-        }
-        return false;
+
+    // Two-way delay measurement packets ("MCQ" / "MCR")
+    if(data[2] == MESHCLOCK_MAGIC_DELAY_REQ) {
+        _onDelayRequest(mac, rx.rxMicros, (const MeshClockDelayReq*)data);
+        return;
     }
-    
-    const MeshClockPacket* packet = (const MeshClockPacket*)data;
-    
-    // Validate magic header "MCK"
-    if(packet->magic[0] != MESHCLOCK_MAGIC_0 ||
-       packet->magic[1] != MESHCLOCK_MAGIC_1 ||
-       packet->magic[2] != MESHCLOCK_MAGIC_2) {
-        if(_debugLog & LOG_RX) {
-            Serial.printf("[MeshClock RX] Discarded: Invalid magic header (%02X %02X %02X)\r\n",
-                          packet->magic[0], packet->magic[1], packet->magic[2]);
-        }
-        return false;
+    if(data[2] == MESHCLOCK_MAGIC_DELAY_RESP) {
+        _onDelayResponse(mac, rx.rxMicros, (const MeshClockDelayResp*)data);
+        return;
     }
-    
-    // Extract 56-bit timestamp (7 bytes) into uint64_t
-    uint64_t remoteMicros = 0;
-    for(int i = 0; i < 7; i++) {
-        remoteMicros |= ((uint64_t)packet->timestamp[i]) << (i * 8);
+    if(data[2] == MESHCLOCK_MAGIC_FOLLOW_UP) {
+        _onFollowUp(mac, (const MeshClockFollowUp*)data);
+        return;
     }
-    
-    if(_debugLog & LOG_RX) {
+
+    MeshClockFrame frame;
+    if(!frame.parse(data, len)) return;
+    uint64_t remoteMicros = frame.timestamp;
+
+    if(_logs(LOG_RX)) {
         uint32_t secs = remoteMicros / 1000000;
         uint32_t usecs = remoteMicros % 1000000;
-        Serial.printf("[MeshClock RX] Valid clock packet: %llu us (%u.%06u s)\r\n", 
-                      remoteMicros, secs, usecs);
+        Serial.printf("[MeshClock RX] Valid clock packet v%u: %llu us (%u.%06u s)\r\n",
+                      frame.version, remoteMicros, secs, usecs);
+    }
+
+    MeshClockPeer *peer = _peer(mac);
+    if(peer) {
+        peer->lastSeen = millis();
+        peer->stratum = frame.stratum;
+        peer->reference = frame.reference;
+        peer->master = frame.flags & MESHCLOCK_FLAG_MASTER;
+        peer->priority = frame.priority;
+        peer->masterSeq = frame.masterSeq;
+    }
+    else if(_untracked < 0xFFFF) _untracked++;
+
+    // Grandmaster still alive: its sequence number moved on (through any peer)
+    if(_mode == SyncMode::GRANDMASTER && (frame.flags & MESHCLOCK_FLAG_MASTER) &&
+       frame.reference == _reference && (int8_t)(frame.masterSeq - _masterSeq) > 0) {
+        _masterSeq = frame.masterSeq;
+        _masterHeard = millis();
+    }
+
+    // Sender stamped with the TRANSMISSION_DELAY_US guess: replace it with the
+    // measured delay of this link, or the mean over measured links
+    uint32_t linkDelay = (peer && peer->linkDelay) ? peer->linkDelay : _meanDelay;
+    if(linkDelay) {
+        remoteMicros += (int64_t)linkDelay - TRANSMISSION_DELAY_US;
     }
     
-    _adjust(remoteMicros);
-    return true;  // Packet was handled
+    // Sender's cumulative steps for the frequency loop (extended packet or field)
+    uint32_t remoteSteps = 0;
+    if(frame.steps) {
+        remoteSteps = unpackLE(frame.steps, 4);
+    }
+
+    // Trailers go out whenever the application sends, and batch records in
+    // the slot of the instance that sent the batch: neither tells our slot
+    if(rx.carrier == MeshClockCarrier::FRAME) _checkSlot(frame.timestamp - TRANSMISSION_DELAY_US);
+
+    // Two-step sender: its precise send time is on the way, hold the
+    // arrival stamp until then (untracked senders are taken as they come)
+    if((frame.flags & MESHCLOCK_FLAG_TWO_STEP) && peer) {
+        peer->held = true;
+        peer->heldSeq = frame.seq;
+        peer->heldSteps = frame.steps != nullptr;
+        peer->heldStepTotal = remoteSteps;
+        peer->heldRx = rx.rxMicros;
+        return;
+    }
+    // Average mode moves both ways on every sample: an airtime estimate off
+    // either way shifts the consensus on each trailer, so it waits for the
+    // broadcasts
+    if(rx.carrier == MeshClockCarrier::TRAILER && _mode == SyncMode::AVERAGE) return;
+    _adjust(peer, rx.rxMicros, remoteMicros, frame.steps ? &remoteSteps : nullptr, rx.airtime);
+}
+
+// Completes the held frame with the same sequence number; a frame whose
+// follow-up was lost is dropped by the next one. The follow-up carries the
+// measured send time, so the link delay estimate does not apply.
+void ESPNowMeshClock::_onFollowUp(const uint8_t *mac, const MeshClockFollowUp *followUp) {
+    MeshClockPeer *peer = _peer(mac);
+    if(!peer || !peer->held || peer->heldSeq != followUp->seq) return;
+    peer->held = false;
+
+    uint64_t remoteMicros = unpackLE(followUp->timestamp, 7);
+    if(_logs(LOG_RX)) {
+        Serial.printf("[MeshClock RX] Follow-up #%u: %llu us\r\n", followUp->seq, remoteMicros);
+    }
+    _adjust(peer, peer->heldRx, remoteMicros, peer->heldSteps ? &peer->heldStepTotal : nullptr);
+}
+
+// Decode an "MCK" packet or "MCV" frame in place. A field cut short (frame
+// truncated to MESHCLOCK_RX_PACKET) ends the TLV area.
+bool MeshClockFrame::parse(const uint8_t *data, int len) {
+    steps = nullptr;
+    error = 0;
+    stratum = MESHCLOCK_MAX_STRATUM;
+    reference = 0;
+    priority = 0xFF;
+    masterSeq = 0;
+    fields = nullptr;
+    fieldsLen = 0;
+
+    if(data[2] == MESHCLOCK_MAGIC_2) {
+        const MeshClockPacket *packet = (const MeshClockPacket*)data;
+        version = 1;
+        flags = 0;
+        seq = 0;
+        timestamp = unpackLE(packet->timestamp, 7);
+        if(len == sizeof(MeshClockPacketExt)) steps = ((const MeshClockPacketExt*)data)->steps;
+        return true;
+    }
+    if(data[2] != MESHCLOCK_MAGIC_FRAME || len < (int)sizeof(MeshClockFrameHeader)) return false;
+
+    const MeshClockFrameHeader *hdr = (const MeshClockFrameHeader*)data;
+    version = hdr->version;
+    flags = hdr->flags;
+    seq = hdr->seq;
+    timestamp = unpackLE(hdr->timestamp, 7);
+    fields = data + sizeof(MeshClockFrameHeader);
+    fieldsLen = len - sizeof(MeshClockFrameHeader);
+
+    steps = field(MESHCLOCK_FIELD_STEPS, 4);
+    const uint8_t *err = field(MESHCLOCK_FIELD_ERROR, 4);
+    if(err) error = unpackLE(err, 4);
+    const uint8_t *st = field(MESHCLOCK_FIELD_STRATUM, 5);
+    if(st) {
+        stratum = min(st[0], (uint8_t)MESHCLOCK_MAX_STRATUM);
+        reference = unpackLE(st + 1, 4);
+    }
+    const uint8_t *gm = field(MESHCLOCK_FIELD_MASTER, 7);
+    if(gm) {
+        priority = gm[0];
+        reference = unpackLE(gm + 1, 4);
+        stratum = min(gm[5], (uint8_t)MESHCLOCK_MAX_STRATUM);
+        masterSeq = gm[6];
+    } else {
+        flags &= ~MESHCLOCK_FLAG_MASTER;
+    }
+    return true;
+}
+
+const uint8_t *MeshClockFrame::field(uint8_t type, uint8_t minLen) const {
+    for(int i = 0; i + 2 <= fieldsLen; i += 2 + fields[i + 1]) {
+        if(i + 2 + fields[i + 1] > fieldsLen) break;  // Truncated
+        if(fields[i] == type && fields[i + 1] >= minLen) return fields + i + 2;
+    }
+    return nullptr;
 }
 
 void ESPNowMeshClock::setUserCallback(ESPNowRecvCallback callback) {
     _userCallback = callback;
 }
 
+// Runs in the WiFi task once a frame has left the radio. Completions arrive
+// in send order: ours is the one numbered _txMark. Frames sent by others
+// (user frames) shift the count; _nextTx() catches up when it notices.
+void IRAM_ATTR ESPNowMeshClock::handleSent() {
+    uint64_t mesh = meshMicros();
+    _txDone = _txDone + 1;
+    if(_txArmed && (int8_t)(_txDone - _txMark) >= 0) {
+        _txMesh = mesh;
+        _txArmed = false;
+        __sync_synchronize();
+        _txReady = true;
+    }
+}
+
+// Every frame leaves through the one radio: each two-step domain counts it
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+void IRAM_ATTR ESPNowMeshClock::_onSent(const esp_now_send_info_t *tx_info, esp_now_send_status_t status) {
+#else
+void IRAM_ATTR ESPNowMeshClock::_onSent(const uint8_t *mac, esp_now_send_status_t status) {
+#endif
+    for(int i = 0; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        if(_domains[i] && _domains[i]->_twoStep) _domains[i]->handleSent();
+    }
+}
+
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-void ESPNowMeshClock::_onReceive(const esp_now_recv_info *recv_info, const uint8_t *data, int len) {
+void IRAM_ATTR ESPNowMeshClock::_onReceive(const esp_now_recv_info *recv_info, const uint8_t *data, int len) {
     if(_instance) {
+        // Latch arrival time before anything else
+        uint64_t rxMicros = _instance->_clock();
+
         // Extract MAC address from recv_info (new API)
         const uint8_t *mac = recv_info->src_addr;
 
         // Try to handle as clock packet
-        bool handled = _instance->handleReceive(mac, data, len);
+        bool handled = _instance->handleReceive(mac, data, len, rxMicros);
 
-        // If not a clock packet and user callback is set, forward to user
-        if (!handled && _instance->_userCallback) {
-            _instance->_userCallback(mac, data, len);
+        // If not a clock packet, take off its clock trailer (if any) and
+        // forward the rest to the user callback
+        if (!handled) {
+            int payload = _instance->handleTrailer(mac, data, len, rxMicros);
+            if (_instance->_userCallback) _instance->_userCallback(mac, data, payload);
         }
     }
 }
 #else
-void ESPNowMeshClock::_onReceive(const uint8_t *mac, const uint8_t *data, int len) {
+void IRAM_ATTR ESPNowMeshClock::_onReceive(const uint8_t *mac, const uint8_t *data, int len) {
     if(_instance) {
+        // Latch arrival time before anything else
+        uint64_t rxMicros = _instance->_clock();
+
         // Try to handle as clock packet
-        bool handled = _instance->handleReceive(mac, data, len);
+        bool handled = _instance->handleReceive(mac, data, len, rxMicros);
 
-        // If not a clock packet and user callback is set, forward to user
-        if (!handled && _instance->_userCallback) {
-            _instance->_userCallback(mac, data, len);
+        // If not a clock packet, take off its clock trailer (if any) and
+        // forward the rest to the user callback
+        if (!handled) {
+            int payload = _instance->handleTrailer(mac, data, len, rxMicros);
+            if (_instance->_userCallback) _instance->_userCallback(mac, data, payload);
         }
     }
 }
 #endif
 
-void ESPNowMeshClock::_adjust(uint64_t remoteMicros) {
-    uint64_t localMicros = _clock() + _offset;
+// Open addressing on a hash of the NIC-specific MAC bytes. Timed out slots
+// are recycled but never cleared, so probe chains stay intact.
+MeshClockPeer* ESPNowMeshClock::_peer(const uint8_t *mac) {
+    uint32_t nowMs = millis();
+    uint32_t hash = ((((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5]) * 2654435761u) >> 16;
+    MeshClockPeer *slot = nullptr;
+
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        MeshClockPeer *p = &_peers[(hash + i) & (MESHCLOCK_MAX_PEERS - 1)];
+        bool expired = p->lastSeen && nowMs - p->lastSeen > _syncTimeout;
+        if(p->lastSeen && memcmp(p->mac, mac, 6) == 0) {
+            if(!expired) return p;
+            slot = p;  // Came back after a timeout: restart its history
+            break;
+        }
+        if(!slot && (!p->lastSeen || expired)) slot = p;
+        if(!p->lastSeen) break;  // End of probe chain
+    }
+
+    // Not tracked yet: take a free (or timed out) slot. When the table is full
+    // the peer is simply not tracked, so tracked peers keep their history and
+    // delay measurements instead of being evicted by each other.
+    if(slot) {
+        if(slot == _parent) _parent = nullptr;
+        uint32_t linkDelay = memcmp(slot->mac, mac, 6) == 0 ? slot->linkDelay : 0;
+        memset(slot, 0, sizeof(MeshClockPeer));
+        memcpy(slot->mac, mac, 6);
+        slot->quality = 0;  // Trust is earned: followed once enough samples pass the gate
+        slot->linkDelay = linkDelay;
+        slot->stratum = MESHCLOCK_MAX_STRATUM;
+        slot->lastSeen = nowMs;
+    }
+    return slot;
+}
+
+// Outlier gate: compare the new phase with the median of this peer's recent
+// phases, projected along their trend. The gate is scaled by the jitter of a
+// typical peer rather than this one's, so a uniformly noisy link fails often
+// and loses quality instead of widening its own gate. The sample is recorded
+// either way, so a persistent shift is accepted once it fills half the
+// history.
+bool ESPNowMeshClock::_filter(MeshClockPeer *peer, uint32_t phase) {
+    bool pass = true;
+
+    if(peer->count >= MESHCLOCK_PEER_SAMPLES / 2) {
+        int32_t dev[MESHCLOCK_PEER_SAMPLES];
+        int n = peer->count;
+        int first = (peer->head + MESHCLOCK_PEER_SAMPLES - n) % MESHCLOCK_PEER_SAMPLES;
+
+        // Trend: median sample-to-sample change, so a peer that legitimately
+        // drifts against us (ramping phase) is not mistaken for an outlier
+        for(int i = 1; i < n; i++) {
+            dev[i - 1] = (int32_t)(peer->phases[(first + i) % MESHCLOCK_PEER_SAMPLES] -
+                                   peer->phases[(first + i - 1) % MESHCLOCK_PEER_SAMPLES]);
+        }
+        int32_t slope = median(dev, n - 1);
+
+        // History projected to this sample, relative to it
+        for(int i = 0; i < n; i++) {
+            dev[i] = (int32_t)(peer->phases[(first + i) % MESHCLOCK_PEER_SAMPLES] - phase) + slope * (n - i);
+        }
+        int32_t center = median(dev, n);
+        for(int i = 0; i < n; i++) {
+            dev[i] = abs(dev[i] - center);
+        }
+        peer->jitter = median(dev, n);
+
+        uint32_t ref = _refJitter ? min(_refJitter, peer->jitter) : peer->jitter;
+        uint32_t gate = max((uint32_t)MESHCLOCK_OUTLIER_MAD * ref, (uint32_t)MESHCLOCK_OUTLIER_MIN_US);
+        pass = (uint32_t)abs(center) <= gate;
+    }
+
+    peer->quality += ((pass ? 255 : 0) - (int)peer->quality) / 8;
+    peer->phases[peer->head] = phase;
+    peer->head = (peer->head + 1) % MESHCLOCK_PEER_SAMPLES;
+    if(peer->count < MESHCLOCK_PEER_SAMPLES) peer->count++;
+    return pass;
+}
+
+// Send a delay request to the next tracked peer (round robin)
+void ESPNowMeshClock::_probeDelay() {
+    uint32_t nowMs = millis();
+    for(int n = 0; n < MESHCLOCK_MAX_PEERS; n++) {
+        _probeIndex = (_probeIndex + 1) % MESHCLOCK_MAX_PEERS;
+        MeshClockPeer *p = &_peers[_probeIndex];
+        if(!p->lastSeen || nowMs - p->lastSeen > _syncTimeout) continue;
+
+        MeshClockDelayReq req;
+        req.magic[0] = MESHCLOCK_MAGIC_0;
+        req.magic[1] = MESHCLOCK_MAGIC_1;
+        req.magic[2] = MESHCLOCK_MAGIC_DELAY_REQ;
+        memcpy(req.target, p->mac, 6);
+
+        _probeT1 = _clock() & MASK56;
+        packLE(req.t1, _probeT1, 7);
+        if(_send(&req, sizeof(req)) != ESP_OK) {
+            _probeT1 = 0;
+        }
+        return;
+    }
+}
+
+void ESPNowMeshClock::_onDelayRequest(const uint8_t *mac, uint64_t rxMicros, const MeshClockDelayReq *req) {
+    uint64_t t2 = rxMicros;
+    if(memcmp(req->target, _mac, 6) != 0) return;  // Probing someone else
+
+    MeshClockDelayResp resp;
+    resp.magic[0] = MESHCLOCK_MAGIC_0;
+    resp.magic[1] = MESHCLOCK_MAGIC_1;
+    resp.magic[2] = MESHCLOCK_MAGIC_DELAY_RESP;
+    memcpy(resp.target, mac, 6);
+    memcpy(resp.t1, req->t1, 7);
+
+    uint64_t t3 = _clock();
+    packLE(resp.turnaround, t3 - t2, 4);
+    _send(&resp, sizeof(resp));
+}
+
+void ESPNowMeshClock::_onDelayResponse(const uint8_t *mac, uint64_t rxMicros, const MeshClockDelayResp *resp) {
+    uint64_t t4 = rxMicros & MASK56;
+    if(memcmp(resp->target, _mac, 6) != 0) return;  // Answer to someone else
+
+    // Only accept the answer to our outstanding request
+    uint64_t t1 = unpackLE(resp->t1, 7);
+    if(!_probeT1 || t1 != _probeT1) return;
+    _probeT1 = 0;
+
+    int64_t rtt = (int64_t)((t4 - t1) & MASK56) - (int64_t)unpackLE(resp->turnaround, 4);
+    if(rtt <= 0 || rtt > 2 * (int64_t)_largeStep) return;  // Implausible, ignore
+
+    MeshClockPeer *peer = _peer(mac);
+    if(!peer) return;
+    uint32_t oneWay = max(rtt / 2, (int64_t)1);  // 0 would read as "not measured"
+    peer->linkDelay = peer->linkDelay ? (3 * peer->linkDelay + oneWay) / 4 : oneWay;
+
+    uint32_t sum = 0, count = 0;
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        if(_peers[i].lastSeen && _peers[i].linkDelay) {
+            sum += _peers[i].linkDelay;
+            count++;
+        }
+    }
+    if(count) _meanDelay = sum / count;
+
+    if(_logs(LOG_DELAY)) {
+        Serial.printf("[MeshClock DELAY] %02X:%02X:%02X:%02X:%02X:%02X round trip %lld us, one-way %u us (avg %u us)\r\n",
+                      mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], rtt, oneWay, peer->linkDelay);
+    }
+}
+
+// Frequency-locked loop: once both sides' offset steps are removed, the phase
+// of a peer only drifts when the oscillators run at different rates, so its
+// slope between two samples is our residual frequency error against that peer.
+// Constant link delay bias cancels out, and every node moving toward its peers
+// makes the whole mesh converge on a common rate.
+void ESPNowMeshClock::_discipline(MeshClockPeer *peer, uint64_t localMicros, uint32_t phase, bool discontinuity) {
+    if(peer->valid && !discontinuity) {
+        uint64_t dt = localMicros - peer->lastLocal;
+        // Keep the older baseline for a longer lever arm. A grandmaster
+        // follower measures against its parent alone, with no averaging
+        // across peers, so it needs a longer one.
+        uint64_t arm = (uint64_t)_interval * 500;
+        if(_mode == SyncMode::GRANDMASTER) arm = max(arm, (uint64_t)8000000);
+        if(dt < arm) return;
+
+        float drift = (float)(int32_t)(phase - peer->lastPhase) / (float)dt;
+        if(fabsf(drift) <= 2 * MESHCLOCK_MAX_RATE_PPM * 1e-6f) {
+            _driftSum += drift;
+            _driftCount++;
+        }
+        // else: implausible slope (peer restarted or lost its baseline), just take a new one
+    }
+
+    peer->lastLocal = localMicros;
+    peer->lastPhase = phase;
+    peer->valid = true;
+}
+
+// Apply the mean drift seen over the last broadcast interval, so the loop
+// gain does not depend on how many peers we hear.
+void ESPNowMeshClock::_updateRate() {
+    if(!_driftCount) return;
+    float drift = _driftSum / _driftCount;
+    _driftSum = 0;
+    _driftCount = 0;
+
+    const int32_t maxRate = (int32_t)(MESHCLOCK_MAX_RATE_PPM * 4294.967296);
+    int64_t rate = _rate + (int64_t)(_freqGain * drift * 4294967296.0f);
+    _rebase(_clock(), (int32_t)constrain(rate, -maxRate, maxRate));
+
+    if(_logs(LOG_SYNC)) {
+        Serial.printf("[MeshClock SYNC] Mean drift vs peers %+.2f ppm, rate now %+.2f ppm\r\n",
+                      drift * 1e6f, getFrequencyPpm());
+    }
+}
+
+// Once per interval: reference jitter for the outlier gate (median over live
+// peers with enough history), the live peer count, and room for untracked
+// senders. While senders overflow the table, a random good peer gives its
+// slot up every few intervals: otherwise the first peers heard at boot would
+// form a closed group that never follows a leader outside it. Low quality
+// peers keep their slot, since being tracked is what keeps them from being
+// followed.
+void ESPNowMeshClock::_updatePeers() {
+    int32_t jitters[MESHCLOCK_MAX_PEERS];
+    int n = 0;
+    uint8_t live = 0;
+    uint32_t nowMs = millis();
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        const MeshClockPeer &p = _peers[i];
+        if(!p.lastSeen || nowMs - p.lastSeen > _syncTimeout) continue;
+        live++;
+        if(p.count >= MESHCLOCK_PEER_SAMPLES / 2) {
+            jitters[n++] = p.jitter;
+        }
+    }
+    _refJitter = n ? median(jitters, n) : 0;
+    _neighbours = live;
+
+    if(_untracked && random(MESHCLOCK_PEER_SAMPLES) == 0) {
+        MeshClockPeer *p = &_peers[random(MESHCLOCK_MAX_PEERS)];
+        if(p->lastSeen && p->count == MESHCLOCK_PEER_SAMPLES && p->quality >= MESHCLOCK_MIN_QUALITY) {
+            memset(p->mac, 0, 6);  // Slot stays occupied for probe chains, free for any sender
+            p->lastSeen = nowMs - _syncTimeout - 1;
+        }
+    }
+    _untracked = 0;
+}
+
+// Our stratum is one more than the best source of the last sync timeout in
+// our reference's tree: a closer peer, the peer whose tree we joined, or a
+// peer without stratum that moved us forward. No recent source means nobody
+// is ahead of us: we are the reference, under our own id.
+void ESPNowMeshClock::_updateStratum() {
+    uint32_t nowMs = millis();
+    bool sourced = false;
+    uint8_t best = MESHCLOCK_MAX_STRATUM;
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        const MeshClockPeer &p = _peers[i];
+        bool sameTree = p.stratum >= MESHCLOCK_MAX_STRATUM || p.reference == _reference;
+        if(p.lastSource && nowMs - p.lastSource <= _syncTimeout && sameTree) {
+            sourced = true;
+            best = min(best, p.stratum);
+        }
+    }
+    _stratum = !sourced ? 0 : min(best + 1, MESHCLOCK_MAX_STRATUM);
+    if(!sourced) _reference = _selfId();
+}
+
+// Switch to the tree of another reference, with this peer as our only source
+void ESPNowMeshClock::_join(MeshClockPeer *peer) {
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        _peers[i].lastSource = 0;
+    }
+    peer->lastSource = millis();
+    _reference = peer->reference;
+    _stratum = min(peer->stratum + 1, MESHCLOCK_MAX_STRATUM);
+}
+
+bool ESPNowMeshClock::_ranksBefore(const MeshClockPeer *peer) {
+    uint8_t stratum = peer->stratum < MESHCLOCK_MAX_STRATUM ? peer->stratum : _stratum;
+    if(stratum != _stratum) return stratum < _stratum;
+    return (uint32_t)unpackLE(peer->mac + 2, 4) < _selfId();
+}
+
+uint32_t ESPNowMeshClock::_selfId() {
+    return (uint32_t)unpackLE(_mac + 2, 4);
+}
+
+// Grandmaster election (BMCA-like), once per interval: the best of our own
+// claim and the masters advertised by live peers, by priority then id; among
+// peers advertising the best master, the fewest hops wins (the current parent
+// on ties) and becomes our parent. A master whose sequence number stopped
+// advancing for MESHCLOCK_MASTER_TIMEOUT intervals is dropped: peers still
+// relaying it are ignored until it shows up with a newer number.
+void ESPNowMeshClock::_elect() {
+    uint32_t nowMs = millis();
+    uint32_t self = _selfId();
+
+    if(_reference != self && nowMs - _masterHeard > (uint32_t)MESHCLOCK_MASTER_TIMEOUT * _maxPeriod()) {
+        if(_logs(LOG_SYNC)) {
+            Serial.printf("[MeshClock SYNC] Grandmaster %08X silent, electing a new one\r\n", (unsigned)_reference);
+        }
+        _deadMaster = _reference;
+        _deadSeq = _masterSeq;
+        _deadAt = nowMs;
+        _reference = self;
+    }
+    bool holdoff = _deadAt && nowMs - _deadAt <= _syncTimeout;
+
+    uint8_t bestPriority = _priority;
+    uint32_t best = self;
+    uint8_t bestHops = 0;
+    MeshClockPeer *parent = nullptr;
+    bool followed = false;
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        MeshClockPeer *p = &_peers[i];
+        if(!p->master || !p->lastSeen || nowMs - p->lastSeen > _syncTimeout) continue;
+        if(p->reference == self) {
+            followed = true;
+            continue;
+        }
+        if(p->stratum >= MESHCLOCK_MAX_STRATUM - 1) continue;
+        if(holdoff && p->reference == _deadMaster && (int8_t)(p->masterSeq - _deadSeq) <= 0) continue;
+
+        uint8_t hops = p->stratum + 1;
+        bool better = p->priority != bestPriority ? p->priority < bestPriority :
+                      p->reference != best ? p->reference < best :
+                      hops != bestHops ? hops < bestHops : p == _parent;
+        if(better) {
+            bestPriority = p->priority;
+            best = p->reference;
+            bestHops = hops;
+            parent = p;
+        }
+    }
+
+    if(best != _reference) {
+        _masterSeq = parent ? parent->masterSeq : _seq;
+        _masterHeard = nowMs;
+        if(_logs(LOG_SYNC)) {
+            Serial.printf("[MeshClock SYNC] Grandmaster now %08X (priority %u, %u hops)\r\n",
+                          (unsigned)best, bestPriority, bestHops);
+        }
+    }
+    _reference = best;
+    _masterPriority = bestPriority;
+    _stratum = bestHops;
+    _parent = parent;
+    if(!parent && followed) _synced = true;  // As the master, synced is having followers
+}
+
+// Grandmaster mode: only the parent (our path to the master) is followed, in
+// both directions; behind it, we run slower instead of stepping back. Other
+// peers still go through their filter, so a failover parent has a history.
+void ESPNowMeshClock::_follow(MeshClockPeer *peer, uint64_t rxMicros, int64_t delta, uint32_t phase, bool discipline, bool largeStep) {
+    if(!peer) {
+        _record(peer, rxMicros, delta, 0, TRACE_UNTRACKED);
+        return;
+    }
+    bool pass = _filter(peer, phase);
+
+    if(peer != _parent) {
+        _record(peer, rxMicros, delta, 0, TRACE_NOT_PARENT);
+        return;
+    }
+
+    if(_freqGain > 0 && discipline && peer->quality >= MESHCLOCK_MIN_QUALITY) {
+        _discipline(peer, rxMicros, phase, largeStep);
+    }
+    if(!largeStep && (!pass || peer->quality < MESHCLOCK_MIN_QUALITY)) {
+        _record(peer, rxMicros, delta, 0, pass ? TRACE_LOW_Q : TRACE_OUTLIER);
+        return;
+    }
+
+    // First sync: set directly, in either direction (nothing can rely on
+    // mesh time yet). Once synced, a large deviation (joining another master)
+    // is stepped forward but slowed down to backward, at MESHCLOCK_CATCHUP_PPM
+    // so two meshes merge in seconds, and meshMicros() never goes back
+    if(largeStep && _synced && delta < 0) {
+        _amortize(delta, MESHCLOCK_CATCHUP_PPM);
+        _record(peer, rxMicros, delta, delta, TRACE_BACK);
+        if(_logs(LOG_SYNC)) {
+            Serial.printf("[MeshClock SYNC] Slowing down to grandmaster. Correction: %lld us\r\n", (int64_t)delta);
+        }
+        return;
+    }
+    if(largeStep) {
+        _amortize(0);
+        _step(delta);
+        _synced = true;
+        _record(peer, rxMicros, delta, delta, TRACE_STEP);
+        if(_logs(LOG_SYNC)) {
+            Serial.printf("[MeshClock SYNC] Direct set to grandmaster. Offset: %lld us, Delta: %lld us\r\n",
+                          (int64_t)_offset, (int64_t)delta);
+        }
+        return;
+    }
+
+    int64_t step = (int64_t)(delta * _alpha);
+    if(step >= 0) {
+        _amortize(0);
+        _step(step);
+        _record(peer, rxMicros, delta, step, TRACE_SLEW);
+    } else {
+        _amortize(step);
+        _record(peer, rxMicros, delta, step, TRACE_BACK);
+    }
+    if(_logs(LOG_SYNC)) {
+        Serial.printf("[MeshClock SYNC] %s grandmaster. Correction: %lld us, Delta: %lld us\r\n",
+                      step >= 0 ? "Slewed forward to" : "Slowing down to", step, (int64_t)delta);
+    }
+}
+
+// Average mode: move towards each of our n neighbours by 1 / (n + 1) of its
+// offset, so a round of samples lands on the mean of them and us. Forward
+// corrections are stepped, backward ones add to the pending slow-down (which
+// a forward one cancels first): mesh time never goes back.
+void ESPNowMeshClock::_average(MeshClockPeer *peer, uint64_t rxMicros, int64_t delta) {
+    int64_t step = delta / (_neighbours + 1);
+    _rebase(_clock(), _rate);
+    int64_t net = _slewLeft + step;
+    if(net >= 0) {
+        _amortize(0);
+        _step(net);
+    } else {
+        _amortize(net);
+    }
+    _record(peer, rxMicros, delta, step, step >= 0 ? TRACE_SLEW : TRACE_BACK);
+    if(_logs(LOG_SYNC)) {
+        Serial.printf("[MeshClock SYNC] Averaged. Correction: %lld us, pending slow-down: %lld us, Delta: %lld us\r\n",
+                      step, net < 0 ? -net : 0, (int64_t)delta);
+    }
+}
+
+// Once per broadcast: back off while synced and settled, else return to the
+// base interval for fast acquisition. Settled means no large deviation and at
+// most one sample in eight beyond link noise (with hundreds of peers, a few
+// always are).
+void ESPNowMeshClock::_adaptInterval() {
+    bool settled = !_unsettled && _noisy * 8 <= _samples;
+    if(!_maxInterval || !settled || getSyncState() != SyncState::SYNCED) {
+        _period = _interval;
+    } else {
+        _period = min(_period * 2, _maxPeriod());
+    }
+    _unsettled = false;
+    _samples = 0;
+    _noisy = 0;
+}
+
+// Longest interval a node of this mesh may wait between broadcasts (all
+// nodes are expected to run the same settings)
+uint32_t ESPNowMeshClock::_maxPeriod() {
+    if(!_maxInterval) return _interval;
+    return max(min((uint32_t)_maxInterval, _syncTimeout / 2), (uint32_t)_interval);
+}
+
+void ESPNowMeshClock::setSlots(uint8_t slots) {
+    _slots = slots;
+    _slot = slots ? (uint8_t)(mix32(_selfId()) % slots) : 0;
+    _nextSlot = 0;
+}
+
+// Our slot in the next base interval of mesh time, at a random point of its
+// first half: two nodes sharing a slot would otherwise always transmit
+// together, and never hear each other to resolve it
+uint64_t ESPNowMeshClock::_slotAfter(uint64_t meshMicros) {
+    uint64_t interval = (uint64_t)_interval * 1000;
+    uint64_t phase = interval * _slot / _slots + random(interval / _slots / 2 + 1);
+    return (meshMicros / interval + 1) * interval + phase;
+}
+
+// A peer broadcast in our slot (it hashed to it too, or moved there): move to
+// a random one. Both sides usually notice, and retry until they differ.
+void ESPNowMeshClock::_checkSlot(uint64_t remoteMicros) {
+    if(!_slots || getSyncState() != SyncState::SYNCED) return;
+    uint64_t interval = (uint64_t)_interval * 1000;
+    if((remoteMicros % interval) * _slots / interval != _slot) return;
+    _slot = random(_slots);
+    _nextSlot = 0;
+    if(_logs(LOG_BCAST)) {
+        Serial.printf("[MeshClock BCAST] Slot taken by a peer, moving to slot %u\r\n", _slot);
+    }
+}
+
+// Offsets within this distance are indistinguishable from link noise
+uint32_t ESPNowMeshClock::_noiseGate() {
+    return max((uint32_t)MESHCLOCK_OUTLIER_MAD * _refJitter, (uint32_t)MESHCLOCK_OUTLIER_MIN_US);
+}
+
+// rxMicros: local clock at reception, so time spent in the queue is not counted as offset
+// airtime: share of remoteMicros that is only an estimate (the airtime of a
+// trailer's payload or of the rest of a batch, at MESHCLOCK_US_PER_BYTE)
+void ESPNowMeshClock::_adjust(MeshClockPeer *peer, uint64_t rxMicros, uint64_t remoteMicros, const uint32_t *remoteSteps, uint16_t airtime) {
+    uint64_t localMicros = _meshAt(rxMicros);
     int64_t  delta = remoteMicros - localMicros;
 
+    // Forward-only, a stamp ahead of the real delay reads as a lead on every
+    // frame and ratchets the mesh forward. Only the part of a lead that is
+    // certain (without the airtime estimate) is followed; the peer's filter
+    // and the rate loop still see the whole estimate, unbiased when the
+    // nominal airtime is right.
+    int64_t lead = _mode == SyncMode::FORWARD_ONLY ? delta - airtime : delta;
+
     // Track last successful sync reception
     _lastSync = millis();
 
-    // Direct clock set needed (first sync or large deviation)
-    if(!_synced || abs(delta) > _largeStep) {
-        if(delta > 0) {
+    bool largeStep = !_synced || abs(delta) > _largeStep;
+
+    // Adaptive interval: a large deviation (e.g. a newcomer) calls for fast
+    // broadcasts right away; corrections beyond link noise are counted. In
+    // forward-only mode a peer behind us corrects itself, so only leads count.
+    int64_t correction = _mode == SyncMode::FORWARD_ONLY ? lead : abs(delta);
+    if(largeStep) _unsettled = true;
+    _samples++;
+    if(correction > (int64_t)_noiseGate()) _noisy++;
+
+    // Suppression: a timestamp agreeing with ours, from a peer ranking before
+    // us (closer to the reference, then lower id), makes our own broadcast
+    // redundant. Ranking keeps the same few nodes talking in each
+    // neighbourhood: peers heard only now and then never build the history
+    // their outlier gate needs.
+    if(peer && !largeStep && (uint32_t)abs(delta) <= _noiseGate() && _ranksBefore(peer)) {
+        _consistent++;
+    }
+    uint32_t phase = (uint32_t)(delta + _steps(rxMicros)) - (remoteSteps ? *remoteSteps : 0);
+
+    // Peer table full: untracked peers cannot be filtered, so once synced
+    // they are only allowed to merge us forward (large step), never to slew
+    if(!peer && !largeStep) {
+        _record(peer, rxMicros, delta, 0, TRACE_UNTRACKED);
+        return;
+    }
+
+    if(_mode == SyncMode::GRANDMASTER) {
+        _follow(peer, rxMicros, delta, phase, remoteSteps != nullptr, largeStep);
+        return;
+    }
+
+    // Peers advertising a stratum (only used with the frequency loop on: a
+    // tree only holds together if its rate locks to the root's): one closer to
+    // our reference keeps counting as our source for as long as we hear it
+    bool ranked = _mode == SyncMode::FORWARD_ONLY && _freqGain > 0 && peer && peer->stratum < MESHCLOCK_MAX_STRATUM;
+    bool foreign = ranked && peer->reference != _reference;
+    bool closer = ranked && !foreign && peer->stratum < _stratum;
+    if(closer) peer->lastSource = millis();
+
+    if(peer) {
+        bool pass = _filter(peer, phase);
+
+        // Learn rate error before this sample's phase correction is applied
+        // (only from peers that report their own steps). Gated samples still
+        // count here: a peer drifting away fails the gate until the rate loop
+        // catches up, so hiding those samples would stall the loop. Peers that
+        // advertise a stratum only count when closer to the reference, so the
+        // rate locks down the tree instead of averaging across it.
+        if(_freqGain > 0 && remoteSteps && (!ranked || closer) && peer->quality >= MESHCLOCK_MIN_QUALITY) {
+            _discipline(peer, rxMicros, phase, largeStep);
+        }
+
+        // Once synced, slews go through the peer's outlier gate (large steps
+        // bypass it: the peer itself stepped, its history no longer applies)
+        if(!largeStep && (!pass || peer->quality < MESHCLOCK_MIN_QUALITY)) {
+            _record(peer, rxMicros, delta, 0, pass ? TRACE_LOW_Q : TRACE_OUTLIER);
+            if(_logs(LOG_SYNC)) {
+                Serial.printf("[MeshClock SYNC] Rejected %s (delta %lld us, jitter %u us, quality %u)\r\n",
+                              pass ? "low quality peer" : "outlier", (int64_t)delta, peer->jitter, peer->quality);
+            }
+            return;
+        }
+    }
+
+    // Prefer sources closer to the reference: a small lead from a peer that
+    // is not closer is taken as link noise (following it would ratchet the
+    // mesh forward hop by hop). A lead beyond the noise gate is real and still
+    // followed; if the peer descends from another reference, that tree runs
+    // ahead of ours and we join it (the rest of our tree follows us the same way).
+    if(!largeStep && ranked && !closer) {
+        int64_t gate = _noiseGate();
+        if(foreign && lead > gate) {
+            _join(peer);
+        } else if(lead > 0 && lead <= gate) {
+            _record(peer, rxMicros, delta, 0, TRACE_STRATUM);
+            return;
+        }
+    }
+
+    // Direct clock set needed (first sync or large deviation): forward-only
+    // in every mode but grandmaster, so two meshes merge on the later clock
+    if(largeStep) {
+        if(lead > 0) {
             // Remote is ahead: adjust forward
-            _offset += delta;
+            _step(lead);
             _synced = true;
-            if(_debugLog & LOG_SYNC) {
+            if(ranked) _join(peer);
+            else if(peer) peer->lastSource = millis();
+            _record(peer, rxMicros, delta, lead, TRACE_STEP);
+            if(_logs(LOG_SYNC)) {
                 Serial.printf("[MeshClock SYNC] Direct set forward. Offset: %lld us, Delta: %lld us\r\n",
-                             (int64_t)_offset, (int64_t)delta);
+                             (int64_t)_offset, (int64_t)lead);
             }
         } else {
             // Remote is behind: ignore (forward-only), but mark as synced
             _synced = true;
-            if(_debugLog & LOG_SYNC) {
+            _record(peer, rxMicros, delta, 0, TRACE_BEHIND);
+            if(_logs(LOG_SYNC)) {
                 Serial.printf("[MeshClock SYNC] Ignored (remote behind by %lld us, forward-only)\r\n",
                              (int64_t)(-delta));
             }
@@ -205,65 +1262,519 @@ void ESPNowMeshClock::_adjust(uint64_t remoteMicros) {
         return;
     }
 
+    if(_mode == SyncMode::AVERAGE) {
+        _average(peer, rxMicros, delta);
+        return;
+    }
+
+    // A source closer to the reference is tracked both ways, as a grandmaster
+    // follower tracks its parent: following only its leads would settle us on
+    // the high side of its link noise, a bias that adds up with every hop.
+    // Behind is certain only without the lead's airtime estimate.
+    if(closer && delta < 0) {
+        int64_t step = (int64_t)(delta * _alpha);
+        _amortize(step);
+        _record(peer, rxMicros, delta, step, TRACE_BACK);
+        if(_logs(LOG_SYNC)) {
+            Serial.printf("[MeshClock SYNC] Slowing down to source. Correction: %lld us, Delta: %lld us\r\n",
+                          step, (int64_t)delta);
+        }
+        return;
+    }
+
     // Small adjustment: slew forward only
-    if(delta > 0) {
-        uint64_t step = (uint64_t)(delta * _alpha);
-        _offset += step;
-        if(_debugLog & LOG_SYNC) {
+    if(lead > 0) {
+        uint64_t step = (uint64_t)(lead * _alpha);
+        _amortize(0);
+        _step(step);
+        if(peer && peer->stratum >= MESHCLOCK_MAX_STRATUM) peer->lastSource = millis();
+        _record(peer, rxMicros, delta, step, TRACE_SLEW);
+        if(_logs(LOG_SYNC)) {
             Serial.printf("[MeshClock SYNC] Slewed forward. Offset: %lld us, Step: %llu us, Delta: %lld us\r\n",
                           (int64_t)_offset, step, (int64_t)delta);
         }
     } else {
         // Remote is behind or equal: no adjustment (forward-only)
-        if(_debugLog & LOG_SYNC) {
+        _record(peer, rxMicros, delta, 0, TRACE_NONE);
+        if(_logs(LOG_SYNC)) {
             Serial.printf("[MeshClock SYNC] No adjustment (remote behind by %lld us)\r\n",
-                         (int64_t)(-delta));
+                         (int64_t)(-lead));
         }
     }
 }
 
+// Broadcast a clock packet, wrapped in the domain header unless in domain 0
+esp_err_t ESPNowMeshClock::_send(const void *packet, size_t len) {
+    esp_err_t result;
+    if(_domain == 0) {
+        result = esp_now_send(bcastAddr, (const uint8_t*)packet, len);
+    } else {
+        uint8_t frame[sizeof(MeshClockDomainHeader) + MESHCLOCK_RX_PACKET];
+        MeshClockDomainHeader *hdr = (MeshClockDomainHeader*)frame;
+        hdr->magic[0] = MESHCLOCK_MAGIC_0;
+        hdr->magic[1] = MESHCLOCK_MAGIC_1;
+        hdr->magic[2] = MESHCLOCK_MAGIC_DOMAIN;
+        hdr->domain = _domain;
+        memcpy(frame + sizeof(MeshClockDomainHeader), packet, len);
+        result = esp_now_send(bcastAddr, frame, sizeof(MeshClockDomainHeader) + len);
+    }
+    if(result == ESP_OK) _txSent = _nextTx();
+    return result;
+}
+
+// Number the next frame we queue will complete as. More completions than
+// frames we sent means others' frames went out in between: start from there.
+uint8_t ESPNowMeshClock::_nextTx() {
+    if((int8_t)(_txDone - _txSent) > 0) _txSent = _txDone;
+    return _txSent + 1;
+}
+
+// Min-heap on meshUs, caller holds _eventLock
+static int heapUp(MeshClockEvent *heap, int i) {
+    while(i > 0) {
+        int parent = (i - 1) / 2;
+        if(heap[parent].meshUs <= heap[i].meshUs) break;
+        MeshClockEvent tmp = heap[parent];
+        heap[parent] = heap[i];
+        heap[i] = tmp;
+        i = parent;
+    }
+    return i;
+}
+
+static void heapDown(MeshClockEvent *heap, int count, int i) {
+    for(;;) {
+        int least = i;
+        int l = 2 * i + 1, r = l + 1;
+        if(l < count && heap[l].meshUs < heap[least].meshUs) least = l;
+        if(r < count && heap[r].meshUs < heap[least].meshUs) least = r;
+        if(least == i) break;
+        MeshClockEvent tmp = heap[least];
+        heap[least] = heap[i];
+        heap[i] = tmp;
+        i = least;
+    }
+}
+
+bool ESPNowMeshClock::scheduleAt(uint64_t meshUs, MeshEventCallback callback, void *arg) {
+    if(!callback || !_alarm) return false;
+
+    portENTER_CRITICAL(&_eventLock);
+    if(_eventCount >= MESHCLOCK_MAX_EVENTS) {
+        portEXIT_CRITICAL(&_eventLock);
+        return false;
+    }
+    MeshClockEvent &ev = _events[_eventCount];
+    ev.meshUs = meshUs;
+    ev.callback = callback;
+    ev.arg = arg;
+    bool first = heapUp(_events, _eventCount++) == 0;
+    _eventGen++;
+    portEXIT_CRITICAL(&_eventLock);
+
+    if(first) _armAlarm();
+    return true;
+}
+
+int ESPNowMeshClock::cancel(MeshEventCallback callback, void *arg) {
+    portENTER_CRITICAL(&_eventLock);
+    int kept = 0;
+    for(int i = 0; i < _eventCount; i++) {
+        if(_events[i].callback != callback || _events[i].arg != arg) _events[kept++] = _events[i];
+    }
+    int removed = _eventCount - kept;
+    if(removed) {
+        _eventCount = kept;
+        for(int i = kept / 2 - 1; i >= 0; i--) heapDown(_events, kept, i);
+        _eventGen++;
+    }
+    portEXIT_CRITICAL(&_eventLock);
+
+    if(removed) _armAlarm();  // The earliest may be gone
+    return removed;
+}
+
+// Aim the timer at the earliest event, MESHCLOCK_ALARM_GUARD_US early, on
+// the local clock as projected through the current time base. Runs from
+// scheduling tasks, the esp_timer task and time base updates alike: whoever
+// armed it last must have seen the latest heap and time base, so retry when
+// either changed meanwhile.
+void ESPNowMeshClock::_armAlarm() {
+    uint32_t gen, tbSeq;
+    do {
+        tbSeq = _tbSeq;
+        portENTER_CRITICAL(&_eventLock);
+        gen = _eventGen;
+        uint8_t count = _eventCount;
+        uint64_t at = count ? _events[0].meshUs : 0;
+        portEXIT_CRITICAL(&_eventLock);
+
+        esp_timer_stop(_alarm);
+        if(count) {
+            int64_t wait = (int64_t)(at - meshMicros());
+            if(wait <= MESHCLOCK_ALARM_MAX_US + MESHCLOCK_ALARM_GUARD_US) {
+                wait = (int64_t)(_localAt(at) - _clock());
+            }
+            esp_timer_start_once(_alarm, constrain(wait - MESHCLOCK_ALARM_GUARD_US, (int64_t)0, (int64_t)MESHCLOCK_ALARM_MAX_US));
+        }
+    } while(gen != _eventGen || tbSeq != _tbSeq);
+}
+
+void ESPNowMeshClock::_onAlarm(void *arg) {
+    ((ESPNowMeshClock*)arg)->_runEvents();
+}
+
+// esp_timer task: run what is due, spinning out the guard time on mesh
+// time itself (a step during the spin moves the call with it), then aim
+// at the next event.
+void ESPNowMeshClock::_runEvents() {
+    for(;;) {
+        portENTER_CRITICAL(&_eventLock);
+        if(!_eventCount || (int64_t)(_events[0].meshUs - meshMicros()) > MESHCLOCK_ALARM_GUARD_US) {
+            portEXIT_CRITICAL(&_eventLock);
+            break;
+        }
+        MeshClockEvent ev = _events[0];
+        portEXIT_CRITICAL(&_eventLock);
+
+        // Spin the last microseconds. A backward step meanwhile puts the
+        // event out of reach again: back to the timer instead of spinning
+        // through the step and starving the other esp_timer callbacks.
+        int64_t left;
+        while((left = (int64_t)(ev.meshUs - meshMicros())) > 0 && left <= MESHCLOCK_ALARM_GUARD_US) {}
+        if(left > 0) continue;
+
+        // Take it, unless it was cancelled or overtaken during the spin
+        portENTER_CRITICAL(&_eventLock);
+        bool due = _eventCount && _events[0].meshUs == ev.meshUs && _events[0].callback == ev.callback && _events[0].arg == ev.arg;
+        if(due) {
+            _events[0] = _events[--_eventCount];
+            heapDown(_events, _eventCount, 0);
+            _eventGen++;
+        }
+        portEXIT_CRITICAL(&_eventLock);
+        if(due) ev.callback(ev.meshUs, ev.arg);
+    }
+    _armAlarm();
+}
+
+// Two-step: the last broadcast left the radio, send when it did
+void ESPNowMeshClock::_sendFollowUp() {
+    MeshClockFollowUp followUp;
+    followUp.magic[0] = MESHCLOCK_MAGIC_0;
+    followUp.magic[1] = MESHCLOCK_MAGIC_1;
+    followUp.magic[2] = MESHCLOCK_MAGIC_FOLLOW_UP;
+    followUp.seq = _txSeq;
+    uint64_t stamp = _txMesh + MESHCLOCK_FOLLOWUP_DELAY_US;
+    packLE(followUp.timestamp, stamp, 7);
+
+    if(_send(&followUp, sizeof(followUp)) == ESP_OK) {
+        if(_logs(LOG_BCAST)) {
+            Serial.printf("[MeshClock BCAST] Sent follow-up #%u: %llu us\r\n", _txSeq, stamp);
+        }
+    } else if(_logs(LOG_BCAST)) {
+        Serial.println("[MeshClock ERROR] Failed to send follow-up");
+    }
+}
+
+// Sync trace: one 16-byte store per event, compiled out when MESHCLOCK_TRACE_SIZE is 0
+void ESPNowMeshClock::_record(MeshClockPeer *peer, uint64_t rxMicros, int64_t delta, int64_t step, TraceEvent event) {
+    #if MESHCLOCK_TRACE_SIZE > 0
+    MeshClockTraceEvent e;
+    e.micros = (uint32_t)rxMicros;
+    e.delta = saturate32(delta);
+    e.step = saturate32(step);
+    e.peer = peer ? (uint8_t)(peer - _peers) : 0xFF;
+    e.event = event;
+    e.state = (uint8_t)(_synced ? SyncState::SYNCED : SyncState::ALONE);
+    e.quality = peer ? peer->quality : 0;
+    _trace[_traceCount & (MESHCLOCK_TRACE_SIZE - 1)] = e;
+    _traceCount++;
+    #endif
+}
+
+// Text dump for extras/tracedecode: header, peer table (slot -> MAC at dump
+// time), then one little-endian hex line per event, oldest first
+size_t ESPNowMeshClock::dumpTrace(Print &out) {
+    #if MESHCLOCK_TRACE_SIZE > 0
+    uint32_t count = _traceCount;
+    uint32_t n = count < MESHCLOCK_TRACE_SIZE ? count : MESHCLOCK_TRACE_SIZE;
+    out.printf("MCTRACE 1 %u %u\r\n", (unsigned)n, (unsigned)count);
+    for(int i = 0; i < MESHCLOCK_MAX_PEERS; i++) {
+        const uint8_t *m = _peers[i].mac;
+        if(m[0] | m[1] | m[2] | m[3] | m[4] | m[5]) {
+            out.printf("MCPEER %d %02X:%02X:%02X:%02X:%02X:%02X\r\n", i, m[0], m[1], m[2], m[3], m[4], m[5]);
+        }
+    }
+    for(uint32_t i = count - n; i != count; i++) {
+        const uint8_t *b = (const uint8_t*)&_trace[i & (MESHCLOCK_TRACE_SIZE - 1)];
+        char line[2 * sizeof(MeshClockTraceEvent) + 1];
+        for(size_t j = 0; j < sizeof(MeshClockTraceEvent); j++) {
+            sprintf(line + 2 * j, "%02x", b[j]);
+        }
+        out.printf("%s\r\n", line);
+    }
+    out.printf("MCTRACE END\r\n");
+    return n;
+    #else
+    (void)out;
+    return 0;
+    #endif
+}
+
+// Append one TLV field to an MCV frame, returns the new length
+static size_t addField(uint8_t *frame, size_t len, uint8_t type, uint64_t value, uint8_t size) {
+    frame[len] = type;
+    frame[len + 1] = size;
+    packLE(frame + len + 2, value, size);
+    return len + 2 + size;
+}
+
 void ESPNowMeshClock::_broadcast() {
-    uint64_t stamp = meshMicros() + TRANSMISSION_DELAY_US;
+    if(_batching && _broadcastBatch()) return;
 
-    // Prepare packet with magic header and 7-byte timestamp
-    MeshClockPacket packet;
-    packet.magic[0] = MESHCLOCK_MAGIC_0;
-    packet.magic[1] = MESHCLOCK_MAGIC_1;
-    packet.magic[2] = MESHCLOCK_MAGIC_2;
+    uint64_t stamp = meshMicros() + TRANSMISSION_DELAY_US;
+    uint8_t packet[MESHCLOCK_RX_PACKET];
+    size_t len = _buildPacket(packet, stamp);
 
-    // Pack 56-bit timestamp (7 bytes, little-endian)
-    for(int i = 0; i < 7; i++) {
-        packet.timestamp[i] = (stamp >> (i * 8)) & 0xFF;
+    // Two-step: flag the frame and watch for its send completion (armed
+    // before sending, the callback may run before esp_now_send() returns)
+    bool twoStep = _twoStep && packet[2] == MESHCLOCK_MAGIC_FRAME;
+    if(twoStep) {
+        MeshClockFrameHeader *hdr = (MeshClockFrameHeader*)packet;
+        hdr->flags |= MESHCLOCK_FLAG_TWO_STEP;
+        _txSeq = hdr->seq;
+        _txMark = _nextTx();
+        _txReady = false;
+        __sync_synchronize();
+        _txArmed = true;
     }
 
-    esp_err_t result = esp_now_send(bcastAddr, (uint8_t*)&packet, sizeof(packet));
+    esp_err_t result = _send(packet, len);
+    if(twoStep && result != ESP_OK) _txArmed = false;
     if(result == ESP_OK) {
-        if(_debugLog & LOG_BCAST) {
+        if(_logs(LOG_BCAST)) {
             uint32_t secs = stamp / 1000000;
             uint32_t usecs = stamp % 1000000;
-            Serial.printf("[MeshClock BCAST] Sent time: %llu us (%u.%06u s)\\r\\n", stamp, secs, usecs);
+            Serial.printf("[MeshClock BCAST] Sent time: %llu us (%u.%06u s, %u bytes)\r\n", stamp, secs, usecs, (unsigned)len);
         }
     } else {
-        if(_debugLog & LOG_BCAST) {
+        if(_logs(LOG_BCAST)) {
             Serial.println("[MeshClock ERROR] Failed to send time");
         }
     }
 }
 
+// Batched broadcast: our packet, then those of the other batching instances.
+// false (nothing sent) when no other instance takes part.
+bool ESPNowMeshClock::_broadcastBatch() {
+    int others = 0;
+    for(int i = 0; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        if(_domains[i] && _domains[i] != this && _domains[i]->_batching) others++;
+    }
+    if(!others) return false;
+
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+    uint8_t at[MESHCLOCK_MAX_DOMAINS + 1];  // Offset of each record's packet
+    int records = 0;
+    frame[0] = MESHCLOCK_MAGIC_0;
+    frame[1] = MESHCLOCK_MAGIC_1;
+    frame[2] = MESHCLOCK_MAGIC_BATCH;
+    size_t len = 3;
+
+    for(int i = -1; i < MESHCLOCK_MAX_DOMAINS; i++) {
+        ESPNowMeshClock *clk = i < 0 ? this : _domains[i];
+        if(!clk || (i >= 0 && (clk == this || !clk->_batching))) continue;
+        if(len + 2 + MESHCLOCK_RX_PACKET > sizeof(frame)) break;
+        uint8_t *rec = frame + len;
+        rec[0] = clk->_domain;
+        rec[1] = clk->_buildPacket(rec + 2, clk->meshMicros() + TRANSMISSION_DELAY_US);
+        at[records++] = len + 2;
+        len += 2 + rec[1];
+        if(clk != this) clk->_trailers++;  // Skips its own broadcast
+    }
+
+    // Receivers get every record once the whole frame is on the air
+    for(int r = 0; r < records; r++) {
+        uint8_t *packet = frame + at[r];
+        uint8_t *ts = packet + (packet[2] == MESHCLOCK_MAGIC_FRAME ? offsetof(MeshClockFrameHeader, timestamp) : offsetof(MeshClockPacket, timestamp));
+        packLE(ts, unpackLE(ts, 7) + (len - packet[-1]) * MESHCLOCK_US_PER_BYTE, 7);
+    }
+
+    if(esp_now_send(bcastAddr, frame, len) == ESP_OK) {
+        _txSent = _nextTx();
+        if(_logs(LOG_BCAST)) {
+            Serial.printf("[MeshClock BCAST] Sent batch: %d domains, %u bytes\r\n", records, (unsigned)len);
+        }
+    } else if(_logs(LOG_BCAST)) {
+        Serial.println("[MeshClock ERROR] Failed to send batch");
+    }
+    return true;
+}
+
+size_t ESPNowMeshClock::appendTrailer(uint8_t *buf, size_t len, size_t size) {
+    // The receiver gets the frame once the user payload in front went out too
+    uint64_t stamp = meshMicros() + TRANSMISSION_DELAY_US + (uint64_t)(len + 4) * MESHCLOCK_US_PER_BYTE;
+    uint8_t packet[MESHCLOCK_RX_PACKET];
+    size_t n = _buildPacket(packet, stamp);
+    size_t wrap = _domain ? sizeof(MeshClockDomainHeader) : 0;
+    if(len + wrap + n + 4 > size) return len;
+
+    uint8_t *t = buf + len;
+    if(wrap) {
+        MeshClockDomainHeader *hdr = (MeshClockDomainHeader*)t;
+        hdr->magic[0] = MESHCLOCK_MAGIC_0;
+        hdr->magic[1] = MESHCLOCK_MAGIC_1;
+        hdr->magic[2] = MESHCLOCK_MAGIC_DOMAIN;
+        hdr->domain = _domain;
+    }
+    memcpy(t + wrap, packet, n);
+    t += wrap + n;
+    t[0] = wrap + n;
+    t[1] = MESHCLOCK_MAGIC_0;
+    t[2] = MESHCLOCK_MAGIC_1;
+    t[3] = MESHCLOCK_MAGIC_TRAILER;
+    // Only in grandmaster mode do trailers stand in for the broadcast: the
+    // other modes need the exact stamps (see _adjust())
+    if(_mode == SyncMode::GRANDMASTER) _trailers++;
+    return len + wrap + n + 4;
+}
+
+// Clock packet stamped with stamp, for a broadcast or a trailer: the "MCK"
+// packet, or the versioned frame with the fields that apply to this node.
+// out holds MESHCLOCK_RX_PACKET bytes.
+size_t ESPNowMeshClock::_buildPacket(uint8_t *out, uint64_t stamp) {
+    if(_packetVersion < 2 && _mode != SyncMode::GRANDMASTER) {
+        // Magic header and 7-byte timestamp
+        MeshClockPacketExt *packet = (MeshClockPacketExt*)out;
+        packet->base.magic[0] = MESHCLOCK_MAGIC_0;
+        packet->base.magic[1] = MESHCLOCK_MAGIC_1;
+        packet->base.magic[2] = MESHCLOCK_MAGIC_2;
+
+        // Pack 56-bit timestamp (7 bytes, little-endian)
+        packLE(packet->base.timestamp, stamp, 7);
+
+        // Frequency discipline: append our step total (14-byte extended packet)
+        if(_freqGain > 0) {
+            packLE(packet->steps, (uint64_t)_stepTotal, 4);
+            return sizeof(MeshClockPacketExt);
+        }
+        return sizeof(MeshClockPacket);
+    }
+
+    MeshClockFrameHeader *hdr = (MeshClockFrameHeader*)out;
+    hdr->magic[0] = MESHCLOCK_MAGIC_0;
+    hdr->magic[1] = MESHCLOCK_MAGIC_1;
+    hdr->magic[2] = MESHCLOCK_MAGIC_FRAME;
+    hdr->version = MESHCLOCK_FRAME_VERSION;
+    hdr->flags = (_synced ? MESHCLOCK_FLAG_SYNCED : 0) | (_freqGain > 0 ? MESHCLOCK_FLAG_FREQ : 0) |
+                 (_mode == SyncMode::GRANDMASTER ? MESHCLOCK_FLAG_MASTER : 0);
+    hdr->seq = _seq++;
+    packLE(hdr->timestamp, stamp, 7);
+
+    size_t len = sizeof(MeshClockFrameHeader);
+    if(_freqGain > 0) {
+        len = addField(out, len, MESHCLOCK_FIELD_STEPS, (uint64_t)_stepTotal, 4);
+    }
+    if(_synced && _refJitter) {
+        len = addField(out, len, MESHCLOCK_FIELD_ERROR, _refJitter, 4);
+    }
+    if(_mode == SyncMode::GRANDMASTER) {
+        // As the master, our frame sequence number is the one followers watch
+        if(_stratum == 0) _masterSeq = hdr->seq;
+        uint64_t master = _masterPriority | ((uint64_t)_reference << 8) | ((uint64_t)_stratum << 40) | ((uint64_t)_masterSeq << 48);
+        len = addField(out, len, MESHCLOCK_FIELD_MASTER, master, 7);
+    } else if(_mode == SyncMode::FORWARD_ONLY && _freqGain > 0) {
+        len = addField(out, len, MESHCLOCK_FIELD_STRATUM, _stratum | ((uint64_t)_reference << 8), 5);
+    }
+    return len;
+}
+
 void ESPNowMeshClock::loop() {
     uint32_t nowMs = millis();
 
-    // Calculate randomized interval on first call or after each broadcast
-    if (_nextBroadcastDelay == 0) {
-        // Add random variation: interval ± random_variation_percent
-        int32_t variation = (_interval * _randomVariation) / 100;
-        int32_t randomOffset = random(-variation, variation + 1);
-        _nextBroadcastDelay = _interval + randomOffset;
+    // Apply packets queued by the receive callback
+    while(_rxTail != _rxHead) {
+        __sync_synchronize();
+        _process(_rx[_rxTail & (MESHCLOCK_RX_QUEUE - 1)]);
+        __sync_synchronize();
+        _rxTail = _rxTail + 1;
+    }
+    if(_rxDropped) {
+        if(_logs(LOG_RX)) {
+            Serial.printf("[MeshClock RX] Queue full, dropped %u packets\r\n", _rxDropped);
+        }
+        _rxDropped = 0;
+    }
+
+    if(_txReady) {
+        __sync_synchronize();
+        _txReady = false;
+        _sendFollowUp();
+    }
+
+    // Backed off but something moved: shorten the wait already under way
+    if (_unsettled && _period > _interval) {
+        _period = _interval;
+        _nextBroadcastDelay = 0;
+        _nextSlot = 0;
+    }
+
+    bool due;
+    bool slotted = _slots && getSyncState() == SyncState::SYNCED;
+    if (slotted) {
+        // Broadcast at our slot in mesh time; re-aim when just synced or
+        // when mesh time moved back past the slot (large step)
+        uint64_t mesh = meshMicros();
+        if (!_nextSlot || _nextSlot > mesh + (uint64_t)_period * 1000) {
+            _nextSlot = _slotAfter(mesh);
+        }
+        due = mesh >= _nextSlot;
+    } else {
+        // Calculate randomized interval on first call or after each broadcast
+        if (_nextBroadcastDelay == 0) {
+            // Add random variation: interval ± random_variation_percent
+            int32_t variation = (_period * _randomVariation) / 100;
+            int32_t randomOffset = random(-variation, variation + 1);
+            _nextBroadcastDelay = _period + randomOffset;
+        }
+        due = nowMs - _lastBroadcast >= _nextBroadcastDelay;
     }
 
-    if (nowMs - _lastBroadcast >= _nextBroadcastDelay) {
+    if (due) {
         _lastBroadcast = nowMs;
         _nextBroadcastDelay = 0; // Reset to recalculate next time
-        _broadcast();
+        _rebase(_clock(), _rate);
+        _updateRate();
+        _updatePeers();
+        _adaptInterval();
+        if(_mode == SyncMode::GRANDMASTER) _elect();
+        else if(_mode == SyncMode::FORWARD_ONLY) _updateStratum();
+        if(_trailers) {
+            if(_logs(LOG_BCAST)) {
+                Serial.printf("[MeshClock BCAST] Skipped (time sent in %u trailers)\r\n", _trailers);
+            }
+        } else if(_suppress && _consistent >= _suppress && !isGrandmaster()) {
+            if(_logs(LOG_BCAST)) {
+                Serial.printf("[MeshClock BCAST] Suppressed (%u consistent timestamps heard)\r\n", _consistent);
+            }
+        } else {
+            _broadcast();
+        }
+        _consistent = 0;
+        _trailers = 0;
+        // Our slot one period on (slots stay on the base interval grid)
+        if (slotted) _nextSlot = _slotAfter(meshMicros() + ((uint64_t)_period - _interval) * 1000);
+    }
+
+    // End a backward slew on time
+    if (_slewRate && (int64_t)(_clock() - _slewEnd) >= 0) {
+        _rebase(_clock(), _rate);
+    }
+
+    // Two-way delay measurement, one peer per period
+    if (_delayPeriod && nowMs - _lastDelayProbe >= _delayPeriod) {
+        _lastDelayProbe = nowMs;
+        _probeDelay();
     }
 }
\ No newline at end of file
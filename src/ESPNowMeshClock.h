@@ -20,6 +20,7 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <esp_now.h>
+#include <esp_timer.h>
 #include "libclock/fastmillis.h"
 
 // Magic header for mesh clock packets: "MCK"
@@ -27,10 +28,122 @@
 #define MESHCLOCK_MAGIC_1 0x43  // 'C'
 #define MESHCLOCK_MAGIC_2 0x4B  // 'K'
 
+// Third magic byte of the two-way delay measurement packets ("MCQ" / "MCR")
+#define MESHCLOCK_MAGIC_DELAY_REQ  0x51  // 'Q'
+#define MESHCLOCK_MAGIC_DELAY_RESP 0x52  // 'R'
+
+// Third magic byte of the versioned clock frame ("MCV"), see MeshClockFrameHeader
+#define MESHCLOCK_MAGIC_FRAME 0x56  // 'V'
+#define MESHCLOCK_FRAME_VERSION 2   // Written by this library (the bare "MCK" packets count as version 1)
+
+// MeshClockFrameHeader flags
+#define MESHCLOCK_FLAG_SYNCED 0x01  // Sender has synced to a peer at least once
+#define MESHCLOCK_FLAG_FREQ   0x02  // Sender runs frequency discipline
+#define MESHCLOCK_FLAG_MASTER 0x04  // Sender runs grandmaster mode (MESHCLOCK_FIELD_MASTER present)
+#define MESHCLOCK_FLAG_TWO_STEP 0x08  // Precise send time follows in a "MCF" packet (setTwoStep())
+
+// MeshClockFrameHeader TLV field types (unknown types are skipped by receivers)
+#define MESHCLOCK_FIELD_STEPS 0x01  // uint32: low 32 bits of the sender's step total (see MeshClockPacketExt)
+#define MESHCLOCK_FIELD_ERROR 0x02  // uint32: sender's estimated error in microseconds
+#define MESHCLOCK_FIELD_STRATUM 0x03  // uint8 hop distance from the reference clock + uint32 reference id
+#define MESHCLOCK_FIELD_MASTER  0x04  // Elected grandmaster: uint8 priority, uint32 id, uint8 hops to it, uint8 its sequence number
+
+// Third magic byte of the two-step follow-up ("MCF"), see MeshClockFollowUp
+#define MESHCLOCK_MAGIC_FOLLOW_UP 0x46  // 'F'
+
+// Third magic byte of the domain wrapper ("MCD"), see MeshClockDomainHeader
+#define MESHCLOCK_MAGIC_DOMAIN 0x44  // 'D'
+
+// Third magic byte of the batched frame ("MCB"), see MeshClockBatch
+#define MESHCLOCK_MAGIC_BATCH 0x42  // 'B'
+
+// Clock trailer at the end of a user frame: clock packet (domain wrapped
+// if needed), its length (1 byte), then "MCT". See appendTrailer().
+#define MESHCLOCK_MAGIC_TRAILER 0x54  // 'T'
+#define MESHCLOCK_TRAILER_MAX (4 + MESHCLOCK_RX_PACKET + 4)  // Room appendTrailer() may need
+
 #ifndef TRANSMISSION_DELAY_US
     #define TRANSMISSION_DELAY_US 1000  // Estimated one-way transmission delay in microseconds
 #endif
 
+#ifndef MESHCLOCK_FOLLOWUP_DELAY_US
+    #define MESHCLOCK_FOLLOWUP_DELAY_US 100  // Two-step: from the sender's send callback to the peers' receive callback
+#endif
+
+#ifndef MESHCLOCK_US_PER_BYTE
+    #define MESHCLOCK_US_PER_BYTE 8  // Airtime per byte at the ESP-NOW PHY rate (1 Mbps), added to trailer stamps for the user payload in front
+#endif
+
+#ifndef MESHCLOCK_MAX_PEERS
+    #define MESHCLOCK_MAX_PEERS 32  // Peer table size, power of two (fixed table, never allocates)
+#endif
+
+#ifndef MESHCLOCK_PEER_SAMPLES
+    #define MESHCLOCK_PEER_SAMPLES 8  // Offset samples kept per peer for outlier rejection
+#endif
+
+#ifndef MESHCLOCK_OUTLIER_MAD
+    #define MESHCLOCK_OUTLIER_MAD 4  // Reject samples further than this many MADs (of the typical peer) from the trend
+#endif
+
+#ifndef MESHCLOCK_OUTLIER_MIN_US
+    #define MESHCLOCK_OUTLIER_MIN_US 100  // Samples within this distance of the trend always pass (microseconds)
+#endif
+
+#ifndef MESHCLOCK_MIN_QUALITY
+    #define MESHCLOCK_MIN_QUALITY 128  // Peers whose quality (0-255) falls below this are not followed
+#endif
+
+#ifndef MESHCLOCK_MAX_RATE_PPM
+    #define MESHCLOCK_MAX_RATE_PPM 200  // Clamp for the learned frequency correction
+#endif
+
+#ifndef MESHCLOCK_RX_QUEUE
+    #define MESHCLOCK_RX_QUEUE 16  // Packets buffered between the receive callback and loop(), power of two
+#endif
+
+#ifndef MESHCLOCK_MAX_STRATUM
+    #define MESHCLOCK_MAX_STRATUM 32  // Hop distances from here up count as unknown (ends counting loops)
+#endif
+
+#ifndef MESHCLOCK_SLEW_PPM
+    #define MESHCLOCK_SLEW_PPM 500  // Rate offset that absorbs backward corrections (grandmaster mode) without going backward
+#endif
+
+#ifndef MESHCLOCK_CATCHUP_PPM
+    #define MESHCLOCK_CATCHUP_PPM 250000  // Same for deviations beyond large_step_us once synced (mesh time at 3/4 speed), below 1000000
+#endif
+
+#ifndef MESHCLOCK_MASTER_TIMEOUT
+    #define MESHCLOCK_MASTER_TIMEOUT 3  // Broadcast intervals without news from the grandmaster before it is replaced
+#endif
+
+#ifndef MESHCLOCK_MAX_DOMAINS
+    #define MESHCLOCK_MAX_DOMAINS 4  // Clock domains (instances) one node can run side by side
+#endif
+
+#ifndef MESHCLOCK_MAX_EVENTS
+    #define MESHCLOCK_MAX_EVENTS 16  // Pending scheduleAt() events (fixed min-heap, never allocates)
+#endif
+
+#ifndef MESHCLOCK_ALARM_GUARD_US
+    #define MESHCLOCK_ALARM_GUARD_US 200  // scheduleAt(): the timer wakes this early, the rest is spun on mesh time
+#endif
+
+#ifndef MESHCLOCK_ALARM_MAX_US
+    #define MESHCLOCK_ALARM_MAX_US 100000  // Longest timer sleep: events further out are re-aimed on the way (bounds drift between esp_timer and the ClockFn)
+#endif
+
+#ifndef MESHCLOCK_LOG_MASK
+    #define MESHCLOCK_LOG_MASK 0xFF  // DebugLog flags compiled in; 0 strips all log code from the sync paths
+#endif
+
+#ifndef MESHCLOCK_TRACE_SIZE
+    #define MESHCLOCK_TRACE_SIZE 0  // Sync events kept in the binary trace ring, power of two (0 = no trace)
+#endif
+
+#define MESHCLOCK_RX_PACKET 48  // Bytes kept per queued packet (longer MCV frames lose their trailing fields)
+
 // Mesh clock packet structure (10 bytes total)
 // 3-byte magic header + 7-byte timestamp (56-bit) = ~2283 years rollover
 struct MeshClockPacket {
@@ -38,12 +151,192 @@ struct MeshClockPacket {
     uint8_t timestamp[7];  // 56-bit microseconds (little-endian)
 };
 
+// Extended packet (14 bytes), sent instead of MeshClockPacket when frequency
+// discipline is enabled. Carries the sender's cumulative offset steps so that
+// receivers can tell its phase corrections apart from oscillator drift.
+// NOTE: nodes running older firmware only accept the 10-byte packet.
+struct MeshClockPacketExt {
+    MeshClockPacket base;
+    uint8_t steps[4];      // Low 32 bits of sender's step total (little-endian)
+};
+
+// Versioned clock frame (13 bytes + TLV fields, sent with setPacketVersion(2)).
+// The header layout is frozen: new information is added as TLV fields
+// (type, length, value), which receivers skip when they do not know the
+// type, so the format grows without breaking deployed nodes.
+struct MeshClockFrameHeader {
+    uint8_t magic[3];      // "MCV" identifier
+    uint8_t version;       // MESHCLOCK_FRAME_VERSION of the sender
+    uint8_t flags;         // MESHCLOCK_FLAG_*
+    uint8_t seq;           // Broadcast sequence number (wraps)
+    uint8_t timestamp[7];  // 56-bit microseconds (little-endian)
+    // uint8_t fields[];   // TLV: type (1), length (1), value (length bytes)
+};
+
+// Any received clock frame (MCK 10 / 14 bytes or MCV), decoded in place:
+// pointers refer to the receive buffer, nothing is copied
+struct MeshClockFrame {
+    uint8_t  version;        // 1 = "MCK" packet, 2+ = "MCV" frame
+    uint8_t  flags;          // MESHCLOCK_FLAG_* (0 for version 1)
+    uint8_t  seq;            // Sequence number (0 for version 1)
+    uint64_t timestamp;      // Sender's mesh time in microseconds
+    const uint8_t *steps;    // 4-byte step total, nullptr if absent
+    uint32_t error;          // Estimated error in microseconds (0 = not sent)
+    uint8_t  stratum;        // Hop distance from the reference (MESHCLOCK_MAX_STRATUM = not sent)
+    uint32_t reference;      // Id of that reference (last 4 bytes of its MAC)
+    uint8_t  priority;       // Grandmaster priority (MESHCLOCK_FIELD_MASTER, which also fills stratum and reference)
+    uint8_t  masterSeq;      // Latest grandmaster sequence number seen by the sender
+    const uint8_t *fields;   // TLV area (nullptr for version 1)
+    uint8_t  fieldsLen;
+
+    bool parse(const uint8_t *data, int len);
+    const uint8_t *field(uint8_t type, uint8_t minLen) const;  // First field of this type, nullptr if absent
+};
+
+// Two-way delay measurement (NTP-style), all times on the local raw clock.
+// Both are sent to the broadcast address (no peer registration needed);
+// only the node whose MAC matches `target` processes them.
+// Request (16 bytes): requester stamps t1 just before sending
+struct MeshClockDelayReq {
+    uint8_t magic[3];       // "MCQ" identifier
+    uint8_t target[6];      // MAC of the peer being measured
+    uint8_t t1[7];          // Requester send time (56-bit, little-endian)
+};
+
+// Response (20 bytes): t1 echoed back with the responder turnaround (t3 - t2),
+// so the requester gets round trip = (t4 - t1) - turnaround
+struct MeshClockDelayResp {
+    uint8_t magic[3];       // "MCR" identifier
+    uint8_t target[6];      // MAC of the requester
+    uint8_t t1[7];          // Echo of the request t1
+    uint8_t turnaround[4];  // Responder receive-to-send time in microseconds
+};
+
+// Two-step follow-up (11 bytes): mesh time at which the MCV frame with this
+// sequence number left the sender (send callback), plus
+// MESHCLOCK_FOLLOWUP_DELAY_US. Replaces that frame's estimated timestamp, so
+// time spent in the sender's transmit queue no longer counts as offset.
+struct MeshClockFollowUp {
+    uint8_t magic[3];      // "MCF" identifier
+    uint8_t seq;           // Sequence number of the frame it completes
+    uint8_t timestamp[7];  // 56-bit microseconds (little-endian)
+};
+
+// Domain wrapper (4 bytes), prepended to every packet of a non-zero domain:
+// "MCD" + domain id + the unchanged MCK / MCQ / MCR packet. Domain 0 is sent
+// bare, so it stays compatible with nodes that predate domains.
+struct MeshClockDomainHeader {
+    uint8_t magic[3];  // "MCD" identifier
+    uint8_t domain;    // Domain id (1-255)
+};
+
+// Batched frame: "MCB", then records of domain id (1 byte), length (1 byte)
+// and a clock packet (MCK or MCV, not domain wrapped), up to
+// ESP_NOW_MAX_DATA_LEN bytes. Lets a node running several domains send them
+// all in one transmission (see setBatching()). Read in place, record by record.
+struct MeshClockBatch {
+    const uint8_t *data;
+    int len;
+    int pos;  // Offset of the next record
+
+    bool parse(const uint8_t *data, int len);  // false if not a batched frame
+    bool next(uint8_t &domain, const uint8_t *&packet, int &packetLen);  // false after the last complete record
+};
+
+// Per-peer state, one slot per MAC in a fixed open-addressing table.
+// phase = delta + all offset steps applied locally - the peer's own reported
+// steps (low 32 bits, wrap-safe): it is invariant to both sides' corrections
+// and only moves with oscillator drift and link noise.
+struct MeshClockPeer {
+    uint8_t  mac[6];
+    uint8_t  quality;    // Running share of samples passing the outlier gate (255 = all)
+    uint8_t  count;      // Valid entries in phases[]
+    uint32_t lastSeen;   // millis() of last packet from this peer (0 = slot never used)
+    uint32_t linkDelay;  // Measured one-way delay in microseconds (0 = not measured yet)
+    uint32_t jitter;     // Median absolute deviation of recent phases in microseconds
+    uint32_t phases[MESHCLOCK_PEER_SAMPLES];  // Recent phases (ring buffer)
+    uint8_t  head;       // Next write position in phases[]
+    bool     valid;      // Frequency loop holds a baseline sample
+    uint64_t lastLocal;  // Local clock at the frequency baseline
+    uint32_t lastPhase;  // Phase at the frequency baseline
+    uint8_t  stratum;    // Advertised hop distance from the reference (MESHCLOCK_MAX_STRATUM = unknown)
+    uint32_t reference;  // Advertised reference id
+    uint32_t lastSource; // millis() when this peer last counted as our time source (0 = never)
+    bool     master;     // Advertises a grandmaster (priority, reference, stratum = hops, masterSeq)
+    uint8_t  priority;
+    uint8_t  masterSeq;
+    bool     held;       // Two-step frame waiting for its follow-up
+    uint8_t  heldSeq;
+    bool     heldSteps;  // It carried the sender's step total (heldStepTotal)
+    uint32_t heldStepTotal;
+    uint64_t heldRx;     // Its arrival stamp
+};
+
+// How a received clock packet travelled
+enum class MeshClockCarrier : uint8_t {
+    FRAME,    // Its own ESP-NOW frame
+    BATCH,    // A record of a batched ("MCB") frame
+    TRAILER   // A trailer on a user frame (appendTrailer())
+};
+
+// Received clock packet waiting for loop(), stamped on arrival
+struct MeshClockRx {
+    uint64_t rxMicros;  // Local clock when the packet reached the receive callback
+    uint8_t  mac[6];
+    uint8_t  len;
+    MeshClockCarrier carrier;
+    uint16_t airtime;   // Batch record or trailer: airtime the sender added to its stamp
+    uint8_t  data[MESHCLOCK_RX_PACKET];
+};
+
+// Sync trace event kinds
+enum TraceEvent : uint8_t {
+    TRACE_STEP      = 0,  // Large step forward (first sync or deviation above large_step_us)
+    TRACE_BEHIND    = 1,  // Large deviation, remote behind: ignored
+    TRACE_SLEW      = 2,  // Slewed forward by alpha * delta
+    TRACE_NONE      = 3,  // Small deviation, remote behind: no adjustment
+    TRACE_OUTLIER   = 4,  // Rejected by the peer's outlier gate
+    TRACE_LOW_Q     = 5,  // Rejected, peer quality below MESHCLOCK_MIN_QUALITY
+    TRACE_UNTRACKED = 6,  // Small deviation from a peer outside the table: ignored
+    TRACE_STRATUM   = 7,  // Small deviation from a peer not closer to the reference: ignored
+    TRACE_BACK      = 8,  // Grandmaster or average mode: remote behind, absorbed by running slower
+    TRACE_NOT_PARENT = 9  // Grandmaster mode: sample from a peer that is not our path to the master: ignored
+};
+
+// One _adjust() outcome in the trace ring (16 bytes, written with a single store)
+struct MeshClockTraceEvent {
+    uint32_t micros;   // Local clock at reception (low 32 bits)
+    int32_t  delta;    // Remote minus mesh time in microseconds (saturated)
+    int32_t  step;     // Offset step applied in microseconds
+    uint8_t  peer;     // Peer table slot (0xFF = untracked)
+    uint8_t  event;    // TraceEvent
+    uint8_t  state;    // SyncState after the event
+    uint8_t  quality;  // Peer quality at the time
+};
+
+// Time base published to meshMicros(): mesh = local + offset + (local - anchor) * rate / 2^32
+struct MeshClockTimebase {
+    uint64_t offset;
+    uint64_t anchor;
+    int32_t  rate;
+};
+
 // User can supply their own clock if desired
 typedef uint64_t (*ClockFn)();
 
 // User callback for ESP-NOW messages (for callback chaining)
 typedef void (*ESPNowRecvCallback)(const uint8_t *mac, const uint8_t *data, int len);
 
+// scheduleAt() callback: the mesh time it was scheduled for, and its argument
+typedef void (*MeshEventCallback)(uint64_t meshUs, void *arg);
+
+// Pending scheduleAt() event
+struct MeshClockEvent {
+    uint64_t meshUs;
+    MeshEventCallback callback;
+    void *arg;
+};
+
 // Synchronization state enumeration
 enum class SyncState {
     ALONE,   // No sync has occurred yet (node is alone)
@@ -51,54 +344,311 @@ enum class SyncState {
     LOST     // Was synced, but timeout exceeded (link lost)
 };
 
+// Synchronization policy
+enum class SyncMode {
+    FORWARD_ONLY,  // Follow the most advanced clock (default)
+    GRANDMASTER,   // Elect one reference (best priority, then lowest id) and follow it both ways
+    AVERAGE        // Converge to the mean of the neighbours, slowing down instead of stepping back
+};
+
 // Debug log flags
 enum DebugLog {
     LOG_BCAST = 0x01,  // Broadcast messages
     LOG_RX    = 0x02,  // Receive messages
     LOG_SYNC  = 0x04,  // Sync adjustments
+    LOG_DELAY = 0x08,  // Two-way delay measurements
     LOG_ALL   = 0xFF   // All messages
 };
 
 class ESPNowMeshClock {
 public:
     ESPNowMeshClock(uint16_t interval_ms = 1000, float slew_alpha = 0.25, uint32_t large_step_us = 10000, uint32_t sync_timeout_ms = 5000, uint8_t random_variation_percent = 10, ClockFn clkfn = nullptr);
+    ~ESPNowMeshClock();
     void begin(bool registerCallback = true);
     void loop(); // Call this often in main loop
     uint64_t meshMicros();
     uint32_t meshMillis();
     SyncState getSyncState();
+
+    // Local clock (the ClockFn) and the mesh time of one of its stamps, e.g.
+    // an edge latched first thing in an ISR and converted afterwards.
+    // Lock-free like meshMicros(): safe from any task and from ISRs.
+    uint64_t localMicros() { return _clock(); }
+    uint64_t meshAt(uint64_t localMicros) { return _meshAt(localMicros); }
+
+    // Run callback(meshUs, arg) when mesh time reaches meshUs (right away if
+    // already past). A one-shot esp_timer wakes MESHCLOCK_ALARM_GUARD_US
+    // early and the last microseconds are spun on meshMicros(), so the call
+    // lands within a few microseconds of the mesh instant (unless a higher
+    // priority task holds the CPU). The timer is re-aimed whenever the
+    // offset or rate changes, so events stay on mesh time while slewing.
+    // Callbacks run in the esp_timer task: keep them short and never block.
+    // Safe from any task and from callbacks once begin() has run. Returns
+    // false before begin() or when MESHCLOCK_MAX_EVENTS are pending.
+    bool scheduleAt(uint64_t meshUs, MeshEventCallback callback, void *arg = nullptr);
+
+    // Drop the pending events with this callback and argument; returns how many
+    int cancel(MeshEventCallback callback, void *arg = nullptr);
     
-    // Debug log control
+    // Clock domain: instances with different ids form independent meshes over
+    // the same radio (up to MESHCLOCK_MAX_DOMAINS per node). Call before begin().
+    // 0 (default) uses the legacy packets.
+    void setDomain(uint8_t domain) { _domain = domain; }
+    uint8_t getDomain() { return _domain; }
+
+    // Batched broadcasts: when this instance broadcasts, the packets of the
+    // other started instances with batching on go out in the same "MCB"
+    // frame, and they skip their own broadcast for that interval. Call
+    // loop() of all of them from one task. Off by default.
+    void setBatching(bool enable) { _batching = enable; }
+
+    // Debug log control (flags outside MESHCLOCK_LOG_MASK are compiled out)
     void setDebugLog(uint8_t flags) { _debugLog = flags; }
+
+    // Sync trace (needs MESHCLOCK_TRACE_SIZE > 0): print the ring, oldest event
+    // first, as hex lines for extras/tracedecode. Returns the number of events.
+    size_t dumpTrace(Print &out = Serial);
+
+    // Frequency discipline: learn the local crystal error against peers and
+    // apply it continuously in meshMicros(). 0 disables (default).
+    void setFrequencyGain(float gain) { _freqGain = gain; }
+    float getFrequencyPpm();
+
+    // Two-way delay measurement: every period_ms, probe one peer (round robin)
+    // and use its measured one-way delay instead of TRANSMISSION_DELAY_US.
+    // 0 disables (default). Requests from peers are always answered.
+    void setDelayMeasurement(uint16_t period_ms) { _delayPeriod = period_ms; }
+
+    // Wire format of the broadcasts: 1 (default) sends the "MCK" packets that
+    // every release understands, 2 sends the versioned "MCV" frame (flags,
+    // sequence number, estimated error). Both are always received.
+    void setPacketVersion(uint8_t version) { _packetVersion = version; }
+
+    // Adaptive broadcast interval: once the node is synced and its samples
+    // stay within link noise, the interval doubles at each broadcast up to
+    // max_ms (capped at half the sync timeout, so peers never expire between
+    // broadcasts); any large or noisy offset, or losing sync, drops it back
+    // to interval_ms. 0 keeps the fixed interval (default).
+    void setMaxInterval(uint16_t max_ms) { _maxInterval = max_ms; }
+    uint32_t getInterval() { return _period; }  // Current broadcast interval in ms
+
+    // Broadcast suppression (Trickle-style): skip a scheduled broadcast when
+    // k consistent timestamps (within link noise, from peers closer to the
+    // reference or with a lower id) were heard since the last one. The
+    // grandmaster always broadcasts. 0 disables (default).
+    void setSuppression(uint8_t k) { _suppress = k; }
+
+    // Slotted broadcasts: while synced, each base interval of mesh time is
+    // split in `slots` slots and the node broadcasts at the start of its own
+    // (picked from a hash of its MAC, moved at random when a peer is heard in
+    // it). Falls back to randomized timing while ALONE or LOST. Use at least
+    // as many slots as nodes in range. 0 disables (default).
+    void setSlots(uint8_t slots);
+    uint8_t getSlot() { return _slot; }
+
+    // Piggyback: append a clock trailer to an outgoing user frame of len
+    // bytes in buf (size bytes of room, up to MESHCLOCK_TRAILER_MAX more are
+    // needed), right before sending it. Returns the new length, or len when
+    // the trailer does not fit. In grandmaster mode, intervals in which a
+    // trailer went out skip their dedicated broadcast. Call from the task
+    // running loop().
+    size_t appendTrailer(uint8_t *buf, size_t len, size_t size);
+
+    // Queue the clock trailer of a received user frame, if any, and return
+    // the payload length without it. The registered receive callback does
+    // this before calling the user callback; with manual receive handling,
+    // call it on frames handleReceive() did not take.
+    int handleTrailer(const uint8_t *mac, const uint8_t *data, int len);
+    int handleTrailer(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros);
+
+    // Two-step timing (PTP follow-up style, version 2 frames only): each
+    // broadcast is followed by a "MCF" packet with the mesh time at which
+    // it actually left the radio, taken in the ESP-NOW send callback.
+    // Receivers hold the frame until then, so congestion in the transmit
+    // queue stops biasing the offset. Call before begin(). With several
+    // domains, the send callback serves every two-step instance.
+    void setTwoStep(bool enable) { _twoStep = enable; }
+
+    // Send completion, for sketches that register their own ESP-NOW send
+    // callback (begin() only registers one with two-step on): call it from
+    // there, for every frame sent, on every two-step instance.
+    void handleSent();
+
+    // Hop distance from the reference clock (0 = this node leads), carried
+    // in version 2 frames with the reference's id. Between peers that
+    // advertise it, small corrections only come from peers closer to the
+    // reference, and the frequency loop only locks to those.
+    uint8_t getStratum() { return _stratum; }
+    uint32_t getReference() { return _reference; }
+
+    // Sync policy. GRANDMASTER elects one node (lowest priority value, then
+    // lowest id) that the others follow in both directions: once synced,
+    // backward corrections (even large ones) slow the clock down instead of
+    // stepping it back, and a silent master is replaced after
+    // MESHCLOCK_MASTER_TIMEOUT intervals. Only the first sync may set mesh
+    // time back.
+    // Sends version 2 frames; use the same mode on the whole mesh.
+    // AVERAGE moves to the mean of this node and its neighbours (slew_alpha
+    // unused), both ways, with the same monotonic slow-down; large deviations
+    // keep the forward-only rule.
+    void setSyncMode(SyncMode mode) { _mode = mode; }
+    SyncMode getSyncMode() { return _mode; }
+    void setPriority(uint8_t priority) { _priority = priority; }  // Grandmaster election, lower wins (default 128)
+    bool isGrandmaster() { return _mode == SyncMode::GRANDMASTER && _stratum == 0; }
     
-    // Option 1: Manual receive handling for custom ESP-NOW integration
+    // Option 1: Manual receive handling for custom ESP-NOW integration.
+    // Only recognizes and queues clock packets (safe in the WiFi callback);
+    // they are applied by the next loop(). Returns false for other packets.
+    // Pass rxMicros (same clock as the ClockFn, latched first thing in your
+    // callback) so work done before this call does not count as offset.
+    // Packets of another started domain are queued to that instance.
     bool handleReceive(const uint8_t *mac, const uint8_t *data, int len);
+    bool handleReceive(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros);
     
     // Option 2: Callback chaining for automatic forwarding of non-clock packets
     void setUserCallback(ESPNowRecvCallback callback);
 
 private:
     uint8_t bcastAddr[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+    uint8_t  _mac[6];
     uint16_t _interval;
     float    _alpha;
     uint32_t _largeStep;
     uint32_t _syncTimeout;
     uint8_t  _randomVariation;
     ClockFn  _clock;
-    uint64_t _offset;
+    uint64_t _offset;      // Working copy, only changed under _tbLock (readers use _tb)
+    int32_t  _rate;        // Frequency correction in 2^-32 units (applied since _rateAnchor)
+    uint64_t _rateAnchor;  // Local time at which the rate correction was last folded into _offset
+    int64_t  _stepTotal;   // Sum of all offset steps applied by _adjust() (slews counted as applied)
+    int32_t  _slewRate;    // Temporary rate offset absorbing _slewLeft (2^-32 units, 0 = none)
+    int64_t  _slewLeft;    // Part of a backward correction not applied as of _rateAnchor (<= 0)
+    uint64_t _slewEnd;     // Local time at which _slewLeft runs out
+    MeshClockTimebase _tb[2];       // Double-buffered snapshot read by meshMicros()
+    volatile uint32_t _tbSeq;       // Bumped after each publish, _tb[_tbSeq & 1] is current
+    portMUX_TYPE _tbLock = portMUX_INITIALIZER_UNLOCKED;  // Serializes writers (WiFi task vs loop())
+    MeshClockEvent _events[MESHCLOCK_MAX_EVENTS];  // Min-heap on meshUs
+    uint8_t  _eventCount;
+    uint32_t _eventGen;    // Bumped on every heap change, so _armAlarm() can tell it raced one
+    portMUX_TYPE _eventLock = portMUX_INITIALIZER_UNLOCKED;  // Heap access (scheduling tasks vs esp_timer task)
+    esp_timer_handle_t _alarm;
+    float    _freqGain;
+    float    _driftSum;    // Sum of per-peer drift estimates since the last rate update
+    uint16_t _driftCount;
+    uint32_t _refJitter;   // Median jitter over tracked peers (outlier gate reference)
+    uint16_t _untracked;   // Packets from senders that did not fit in the table this interval
+    uint8_t  _neighbours;  // Live peers as of the last interval (average mode weighs samples by 1/n)
+    MeshClockPeer _peers[MESHCLOCK_MAX_PEERS];
     bool     _synced;
     uint32_t _lastSync;
     uint32_t _lastBroadcast;
     uint32_t _nextBroadcastDelay;
+    uint32_t _period;      // Current broadcast interval (ms), between _interval and _maxPeriod()
+    uint16_t _maxInterval; // setMaxInterval(), 0 = fixed interval
+    bool     _unsettled;   // Large deviation since the last broadcast
+    uint16_t _samples;     // Samples since the last broadcast
+    uint16_t _noisy;       // ... of which needed a correction beyond link noise
+    uint8_t  _suppress;    // setSuppression(), 0 = always broadcast
+    uint16_t _consistent;  // Consistent samples since the last broadcast slot
+    uint8_t  _slots;       // setSlots(), 0 = randomized timing only
+    uint8_t  _slot;        // Our slot in each base interval
+    uint64_t _nextSlot;    // Mesh time of our next slotted broadcast (0 = to be aimed)
+    uint16_t _trailers;    // Trailers (or batches of another instance) carrying our time since the last broadcast slot
+    bool     _batching;    // setBatching()
+    bool     _twoStep;     // setTwoStep()
+    uint8_t  _txSent;      // Frames we queued (loop side)
+    volatile uint8_t _txDone;   // Send completions seen (callback side)
+    uint8_t  _txMark;      // Number of the broadcast awaiting its completion
+    uint8_t  _txSeq;       // Its frame sequence number
+    volatile bool _txArmed;     // Set by loop, cleared by the callback at completion
+    volatile bool _txReady;     // Set by the callback, cleared by loop once the follow-up is out
+    volatile uint64_t _txMesh;  // Mesh time at completion
     ESPNowRecvCallback _userCallback;
     uint8_t  _debugLog;
+    uint16_t _delayPeriod;
+    uint32_t _lastDelayProbe;
+    uint8_t  _probeIndex;  // Next peer slot to probe
+    uint64_t _probeT1;     // t1 of the outstanding request (0 = none)
+    uint32_t _meanDelay;   // Mean measured one-way delay, used for peers not measured yet (0 = none)
+    MeshClockRx _rx[MESHCLOCK_RX_QUEUE];  // Single producer (receive callback), single consumer (loop)
+    volatile uint16_t _rxHead;  // Next slot written by the producer
+    volatile uint16_t _rxTail;  // Next slot read by the consumer
+    volatile uint16_t _rxDropped;  // Packets lost to a full queue since last reported
+    #if MESHCLOCK_TRACE_SIZE > 0
+    MeshClockTraceEvent _trace[MESHCLOCK_TRACE_SIZE];
+    uint32_t _traceCount;  // Events recorded since begin (next slot = count % size)
+    #endif
 
     #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
     static void _onReceive(const esp_now_recv_info *recv_info, const uint8_t *data, int len);
     #else
     static void _onReceive(const uint8_t *mac, const uint8_t *data, int len);
     #endif
-    static ESPNowMeshClock* _instance;
-    void _adjust(uint64_t remoteMicros);
+    #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+    static void _onSent(const esp_now_send_info_t *tx_info, esp_now_send_status_t status);
+    #else
+    static void _onSent(const uint8_t *mac, esp_now_send_status_t status);
+    #endif
+    uint8_t  _domain;
+    uint8_t  _packetVersion;
+    uint8_t  _seq;         // Sequence number of the next MCV frame
+    uint8_t  _stratum;     // Our hop distance from the reference, derived from recent sources
+    uint32_t _reference;   // Id of the reference we descend from (our own id when stratum is 0)
+    SyncMode _mode;
+    uint8_t  _priority;       // Our grandmaster priority
+    uint8_t  _masterPriority; // Priority of the elected grandmaster (_reference)
+    uint8_t  _masterSeq;      // Its latest sequence number heard
+    uint32_t _masterHeard;    // millis() when that number last advanced
+    uint32_t _deadMaster;     // Last grandmaster dropped for silence, ignored until heard with a newer sequence
+    uint8_t  _deadSeq;
+    uint32_t _deadAt;
+    MeshClockPeer *_parent;   // Peer we follow toward the grandmaster (nullptr when we are it)
+    static ESPNowMeshClock* _instance;  // Owner of the internal receive callback (last begin(true))
+    static ESPNowMeshClock* _domains[MESHCLOCK_MAX_DOMAINS];  // Started instances, looked up by domain id
+    static ESPNowMeshClock* _lookup(uint8_t domain);
+    bool _receive(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros, MeshClockCarrier carrier, uint16_t airtime);
+    void _enqueue(const uint8_t *mac, const uint8_t *data, int len, uint64_t rxMicros,
+                  MeshClockCarrier carrier = MeshClockCarrier::FRAME, uint16_t airtime = 0);
+    esp_err_t _send(const void *packet, size_t len);
+    uint8_t _nextTx();
+    void _sendFollowUp();
+    void _onFollowUp(const uint8_t *mac, const MeshClockFollowUp *followUp);
+    void _process(const MeshClockRx &rx);
+    void _adjust(MeshClockPeer *peer, uint64_t rxMicros, uint64_t remoteMicros, const uint32_t *remoteSteps, uint16_t airtime = 0);
     void _broadcast();
+    static void _onAlarm(void *arg);
+    void _runEvents();
+    void _armAlarm();
+    size_t _buildPacket(uint8_t *out, uint64_t stamp);
+    bool _broadcastBatch();
+    void _record(MeshClockPeer *peer, uint64_t rxMicros, int64_t delta, int64_t step, TraceEvent event);
+    bool _logs(uint8_t flag) const { return (MESHCLOCK_LOG_MASK & flag) && (_debugLog & flag); }  // Constant false when masked out
+    uint64_t _meshAt(uint64_t localMicros);
+    uint64_t _localAt(uint64_t meshMicros);
+    void _reproject();
+    void _publish();
+    void _rebase(uint64_t localMicros, int32_t rate, bool reproject = true);
+    void _step(int64_t step);
+    void _discipline(MeshClockPeer *peer, uint64_t localMicros, uint32_t phase, bool discontinuity);
+    bool _filter(MeshClockPeer *peer, uint32_t phase);
+    void _updateRate();
+    void _updatePeers();
+    void _updateStratum();
+    void _elect();
+    void _follow(MeshClockPeer *peer, uint64_t rxMicros, int64_t delta, uint32_t phase, bool discipline, bool largeStep);
+    void _average(MeshClockPeer *peer, uint64_t rxMicros, int64_t delta);
+    void _adaptInterval();
+    uint32_t _maxPeriod();
+    bool _ranksBefore(const MeshClockPeer *peer);
+    uint64_t _slotAfter(uint64_t meshMicros);
+    void _checkSlot(uint64_t remoteMicros);
+    void _amortize(int64_t amount, uint32_t ppm = MESHCLOCK_SLEW_PPM);
+    int64_t _steps(uint64_t localMicros);
+    void _join(MeshClockPeer *peer);
+    uint32_t _selfId();
+    uint32_t _noiseGate();
+    MeshClockPeer* _peer(const uint8_t *mac);
+    void _probeDelay();
+    void _onDelayRequest(const uint8_t *mac, uint64_t rxMicros, const MeshClockDelayReq *req);
+    void _onDelayResponse(const uint8_t *mac, uint64_t rxMicros, const MeshClockDelayResp *resp);
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+ * ESPNowMeshClock - input capture in mesh time
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MeshCapture.h"
+
+static_assert((MESHCLOCK_CAPTURE_QUEUE & (MESHCLOCK_CAPTURE_QUEUE - 1)) == 0, "MESHCLOCK_CAPTURE_QUEUE must be a power of two");
+
+MeshCapture::MeshCapture(ESPNowMeshClock &clock)
+    : _clock(clock), _pin(-1), _head(0), _tail(0), _dropped(0)
+{
+}
+
+MeshCapture::~MeshCapture() {
+    end();
+}
+
+bool MeshCapture::begin(int pin, int mode) {
+    if(pin < 0) return false;
+    end();
+    _pin = pin;
+    _tail = _head;
+    _dropped = 0;
+    pinMode(_pin, INPUT);
+    attachInterruptArg(digitalPinToInterrupt(_pin), _onEdge, this, mode);
+    return true;
+}
+
+void MeshCapture::end() {
+    if(_pin < 0) return;
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    _pin = -1;
+}
+
+bool MeshCapture::read(MeshCaptureEvent &event) {
+    uint16_t tail = _tail;
+    if(tail == _head) return false;
+    __sync_synchronize();
+    event = _queue[tail & (MESHCLOCK_CAPTURE_QUEUE - 1)];
+    __sync_synchronize();
+    _tail = tail + 1;
+    return true;
+}
+
+// GPIO ISR. The stamp comes first: everything after it is not part of the
+// event time. The conversion reads the time base lock-free.
+void IRAM_ATTR MeshCapture::_onEdge(void *arg) {
+    MeshCapture *capture = (MeshCapture*)arg;
+    uint64_t local = capture->_clock.localMicros();
+    uint16_t head = capture->_head;
+    if((uint16_t)(head - capture->_tail) >= MESHCLOCK_CAPTURE_QUEUE) {
+        capture->_dropped = capture->_dropped + 1;
+        return;
+    }
+    MeshCaptureEvent &event = capture->_queue[head & (MESHCLOCK_CAPTURE_QUEUE - 1)];
+    event.localUs = local;
+    event.meshUs = capture->_clock.meshAt(local);
+    event.pin = capture->_pin;
+    event.level = digitalRead(capture->_pin);
+    __sync_synchronize();
+    capture->_head = head + 1;
+}
@@ -0,0 +1,63 @@
+/*
+ * ESPNowMeshClock - input capture in mesh time
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "ESPNowMeshClock.h"
+
+#ifndef MESHCLOCK_CAPTURE_QUEUE
+    #define MESHCLOCK_CAPTURE_QUEUE 32  // Edges buffered between the ISR and read(), power of two
+#endif
+
+// One captured edge
+struct MeshCaptureEvent {
+    uint64_t meshUs;   // Mesh time of the edge
+    uint64_t localUs;  // Local clock (ClockFn) at the edge
+    uint8_t  pin;
+    uint8_t  level;    // Pin level read after the edge (tells the direction with CHANGE)
+};
+
+// Timestamps GPIO edges in mesh time, so events seen by different nodes
+// (buttons, sensor triggers, timecode edges) can be compared to the
+// microsecond. The interrupt latches the local clock first thing, converts
+// it with the current time base and queues the result; the application
+// drains the queue with read(). One pin per instance: the queue is
+// single-producer (the ISR), single-consumer (the reader).
+class MeshCapture {
+public:
+    MeshCapture(ESPNowMeshClock &clock);
+    ~MeshCapture();
+
+    // Start capturing pin on RISING, FALLING or CHANGE edges
+    bool begin(int pin, int mode = RISING);
+    void end();
+
+    // Oldest captured edge; false when none is waiting
+    bool read(MeshCaptureEvent &event);
+    uint16_t available() { return _head - _tail; }
+    uint32_t getDropped() { return _dropped; }  // Edges lost to a full queue since begin()
+
+private:
+    ESPNowMeshClock &_clock;
+    int _pin;
+    MeshCaptureEvent _queue[MESHCLOCK_CAPTURE_QUEUE];
+    volatile uint16_t _head;  // Next slot written by the ISR
+    volatile uint16_t _tail;  // Next slot read by read()
+    volatile uint32_t _dropped;
+
+    static void _onEdge(void *arg);
+};
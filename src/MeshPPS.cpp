@@ -0,0 +1,192 @@
+/*
+ * ESPNowMeshClock - pulse-per-second output on mesh time
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MeshPPS.h"
+
+// Edges are aimed this far ahead; without the hardware timer scheduleAt()
+// lands on the edge itself
+static const uint32_t ARM_LEAD_US = MESHCLOCK_PPS_GPTIMER ? MESHCLOCK_PPS_LEAD_US : 0;
+
+MeshPPS::MeshPPS(ESPNowMeshClock &clock)
+    : _clock(clock), _pin(-1), _period(0), _width(0), _phase(0), _running(false), _pending(0), _busy(false), _high(false), _pulses(0), _missed(0)
+    #if MESHCLOCK_PPS_GPTIMER
+    , _timer(nullptr)
+    #endif
+{
+}
+
+MeshPPS::~MeshPPS() {
+    end();
+}
+
+bool MeshPPS::begin(int pin, uint32_t periodUs, uint32_t widthUs, uint32_t phaseUs) {
+    if(pin < 0 || !widthUs || (uint64_t)widthUs + MESHCLOCK_PPS_LEAD_US >= periodUs) return false;
+    end();
+    _pin = pin;
+    _period = periodUs;
+    _width = widthUs;
+    _phase = phaseUs % periodUs;
+    _pulses = 0;
+    _missed = 0;
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);
+
+    #if MESHCLOCK_PPS_GPTIMER
+    // 1 MHz: alarms resolve to the microsecond, like mesh time
+    gptimer_config_t config = {};
+    config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+    config.direction = GPTIMER_COUNT_UP;
+    config.resolution_hz = 1000000;
+    if(gptimer_new_timer(&config, &_timer) != ESP_OK) {
+        _timer = nullptr;
+        return false;
+    }
+    gptimer_event_callbacks_t callbacks = {};
+    callbacks.on_alarm = _onAlarm;
+    gptimer_register_event_callbacks(_timer, &callbacks, this);
+    gptimer_enable(_timer);
+    gptimer_start(_timer);
+    #endif
+
+    _running = true;
+    if(!_schedule(_next(_clock.meshMicros() + ARM_LEAD_US) - ARM_LEAD_US)) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+// An arming callback may already be past the heap when we cancel: it sees
+// _running or _pending cleared and leaves the timer alone, or we wait for it
+void MeshPPS::end() {
+    _running = false;
+    _pending = 0;
+    _clock.cancel(_onArm, this);
+    while(_busy) delay(1);
+    _clock.cancel(_onArm, this);  // Rescheduled by the callback we waited for
+    #if MESHCLOCK_PPS_GPTIMER
+    if(_timer) {
+        gptimer_stop(_timer);
+        gptimer_disable(_timer);
+        gptimer_del_timer(_timer);
+        _timer = nullptr;
+    }
+    #else
+    _clock.cancel(_onFall, this);
+    #endif
+    if(_pin >= 0) digitalWrite(_pin, LOW);
+    _high = false;
+}
+
+// First edge after meshUs (_phase itself while mesh time has not reached
+// it, e.g. just after boot)
+uint64_t MeshPPS::_next(uint64_t meshUs) {
+    if(meshUs < _phase) return _phase;
+    uint64_t base = meshUs - _phase;
+    return (base / _period + 1) * _period + _phase;
+}
+
+bool MeshPPS::_schedule(uint64_t at) {
+    _pending = at;
+    return _clock.scheduleAt(at, _onArm, this);
+}
+
+void MeshPPS::_onArm(uint64_t meshUs, void *arg) {
+    MeshPPS *pps = (MeshPPS*)arg;
+    pps->_busy = true;
+
+    // Only the event the chain expects runs: one end() could not cancel in
+    // time, or one begin() replaced, is dropped without touching the timer
+    uint64_t expected = meshUs;
+    if(pps->_pending.compare_exchange_strong(expected, 0) && pps->_running) {
+        uint64_t edge = meshUs + ARM_LEAD_US;
+        pps->_arm(edge);
+
+        // Edges mesh time stepped over (or too close to aim) are skipped
+        uint64_t next = pps->_next(max(pps->_clock.meshMicros() + ARM_LEAD_US, edge));
+        pps->_missed += (next - edge) / pps->_period - 1;
+        if(pps->_running) pps->_schedule(next - ARM_LEAD_US);
+    }
+    pps->_busy = false;
+}
+
+#if MESHCLOCK_PPS_GPTIMER
+
+// esp_timer task, ARM_LEAD_US before the edge: turn the remaining mesh time
+// into a count of the hardware timer. Both run off the same crystal, so the
+// projection holds to the microsecond over the lead.
+void MeshPPS::_arm(uint64_t edge) {
+    portENTER_CRITICAL(&_lock);
+    // Mesh time stepped forward into a pulse: end it, its falling alarm is replaced
+    if(_high) {
+        gpio_set_level((gpio_num_t)_pin, 0);
+        _high = false;
+    }
+    uint64_t count;
+    gptimer_get_raw_count(_timer, &count);
+    uint64_t now = _clock.meshMicros();
+    if(edge > now) {
+        gptimer_alarm_config_t alarm = {};
+        alarm.alarm_count = count + (edge - now);
+        gptimer_set_alarm_action(_timer, &alarm);
+    } else {
+        _missed++;
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+// Timer ISR: rising edge, then the falling one _width later
+bool IRAM_ATTR MeshPPS::_onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg) {
+    MeshPPS *pps = (MeshPPS*)arg;
+    portENTER_CRITICAL_ISR(&pps->_lock);
+    if(!pps->_high) {
+        gpio_set_level((gpio_num_t)pps->_pin, 1);
+        pps->_high = true;
+        pps->_pulses++;
+        gptimer_alarm_config_t alarm = {};
+        alarm.alarm_count = edata->alarm_value + pps->_width;
+        gptimer_set_alarm_action(timer, &alarm);
+    } else {
+        gpio_set_level((gpio_num_t)pps->_pin, 0);
+        pps->_high = false;
+    }
+    portEXIT_CRITICAL_ISR(&pps->_lock);
+    return false;
+}
+
+#else
+
+// esp_timer task, on the edge (scheduleAt() spins onto it)
+void MeshPPS::_arm(uint64_t edge) {
+    if((int64_t)(_clock.meshMicros() - edge) >= MESHCLOCK_PPS_LEAD_US) {
+        _missed++;
+        return;
+    }
+    digitalWrite(_pin, HIGH);
+    _high = true;
+    _pulses++;
+    _clock.scheduleAt(edge + _width, _onFall, this);
+}
+
+void MeshPPS::_onFall(uint64_t meshUs, void *arg) {
+    MeshPPS *pps = (MeshPPS*)arg;
+    digitalWrite(pps->_pin, LOW);
+    pps->_high = false;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * ESPNowMeshClock - pulse-per-second output on mesh time
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <atomic>
+#include "ESPNowMeshClock.h"
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    #include <driver/gptimer.h>
+    #include <driver/gpio.h>
+    #define MESHCLOCK_PPS_GPTIMER 1
+#else
+    #define MESHCLOCK_PPS_GPTIMER 0  // No gptimer driver: edges laid down from scheduleAt()
+#endif
+
+// How far ahead of each edge the hardware timer is armed. The arming runs in
+// the esp_timer task and may be held up by this much before the edge is lost.
+#ifndef MESHCLOCK_PPS_LEAD_US
+    #define MESHCLOCK_PPS_LEAD_US 1000
+#endif
+
+// Pulse output for measuring skew on a scope or logic analyzer: the rising
+// edge of each pulse falls on a mesh time multiple of the period (plus a
+// phase), the same instant on every node. Each edge is aimed through
+// scheduleAt() shortly before it is due, then driven by a general purpose
+// timer alarm, so task scheduling never reaches the pin: what remains is the
+// interrupt latency. It is roughly the same on every node (a few µs) but not
+// constant: cache misses, flash access and other interrupts served first add
+// jitter, typically a few µs and tens of µs under WiFi load (longer during
+// flash writes unless CONFIG_GPTIMER_ISR_IRAM_SAFE is set). Pulses whose edge
+// could not be aimed in time (CPU held up, mesh time stepped over it) are
+// skipped.
+class MeshPPS {
+public:
+    MeshPPS(ESPNowMeshClock &clock);
+    ~MeshPPS();
+
+    // Start pulsing pin: widthUs HIGH every periodUs of mesh time (1 s for
+    // PPS). widthUs + MESHCLOCK_PPS_LEAD_US must be below periodUs.
+    bool begin(int pin, uint32_t periodUs = 1000000, uint32_t widthUs = 100000, uint32_t phaseUs = 0);
+    void end();
+
+    uint32_t getPulses() const { return _pulses; }  // Rising edges driven since begin()
+    uint32_t getMissed() const { return _missed; }  // Edges skipped since begin()
+
+private:
+    ESPNowMeshClock &_clock;
+    int      _pin;
+    uint32_t _period;
+    uint32_t _width;
+    uint32_t _phase;
+    std::atomic<bool>     _running;
+    std::atomic<uint64_t> _pending;  // Mesh time of the one arming event the chain expects (0 = none)
+    std::atomic<bool>     _busy;     // An arming callback is in progress
+    volatile bool _high;   // Pin state, owned by the alarm once running
+    volatile uint32_t _pulses;
+    volatile uint32_t _missed;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    #if MESHCLOCK_PPS_GPTIMER
+    gptimer_handle_t _timer;
+    static bool _onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg);
+    #else
+    static void _onFall(uint64_t meshUs, void *arg);
+    #endif
+
+    uint64_t _next(uint64_t meshUs);
+    bool _schedule(uint64_t at);
+    static void _onArm(uint64_t meshUs, void *arg);
+    void _arm(uint64_t edge);
+};
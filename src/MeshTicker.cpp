@@ -0,0 +1,150 @@
+/*
+ * ESPNowMeshClock - phase-locked ticks on mesh time
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MeshTicker.h"
+
+MeshTicker::MeshTicker(ESPNowMeshClock &clock)
+    : _clock(clock), _period(0), _phase(0), _callback(nullptr), _arg(nullptr), _pin(-1), _pulseUs(0), _running(false), _pending(0),
+      _last(0), _ticks(0), _missed(0), _maxLate(0), _lateSum(0), _lateSq(0)
+{
+}
+
+MeshTicker::~MeshTicker() {
+    end();
+}
+
+bool MeshTicker::begin(uint32_t periodUs, MeshTickCallback callback, void *arg, uint32_t phaseUs) {
+    if(!periodUs) return false;
+    end();
+    _period = periodUs;
+    _phase = phaseUs % periodUs;
+    _callback = callback;
+    _arg = arg;
+    _last = 0;
+    resetStats();
+    if(_pin >= 0) {
+        pinMode(_pin, OUTPUT);
+        digitalWrite(_pin, LOW);
+    }
+    _running = true;
+    if(!_schedule(_next(_clock.meshMicros()))) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+// A tick already past the heap when we cancel sees _running or _pending
+// cleared and stops there, so the chain ends (and end() is safe from the
+// tick callback itself)
+void MeshTicker::end() {
+    _running = false;
+    _pending = 0;
+    _clock.cancel(_onTick, this);
+    _clock.cancel(_onPulseEnd, this);
+    if(_pin >= 0) digitalWrite(_pin, LOW);
+}
+
+MeshTickerStats MeshTicker::getStats() {
+    MeshTickerStats stats;
+    portENTER_CRITICAL(&_statsLock);
+    stats.ticks = _ticks;
+    stats.missed = _missed;
+    stats.maxLateUs = _maxLate;
+    uint64_t sum = _lateSum, sq = _lateSq;
+    portEXIT_CRITICAL(&_statsLock);
+
+    stats.meanLateUs = stats.ticks ? (float)sum / stats.ticks : 0;
+    float var = stats.ticks ? (float)sq / stats.ticks - stats.meanLateUs * stats.meanLateUs : 0;
+    stats.jitterUs = var > 0 ? sqrtf(var) : 0;
+    return stats;
+}
+
+void MeshTicker::resetStats() {
+    portENTER_CRITICAL(&_statsLock);
+    _ticks = 0;
+    _missed = 0;
+    _maxLate = 0;
+    _lateSum = 0;
+    _lateSq = 0;
+    portEXIT_CRITICAL(&_statsLock);
+}
+
+bool MeshTicker::_schedule(uint64_t at) {
+    _pending = at;
+    return _clock.scheduleAt(at, _onTick, this);
+}
+
+// First grid point after meshUs (_phase itself while mesh time has not
+// reached it, e.g. just after boot)
+uint64_t MeshTicker::_next(uint64_t meshUs) {
+    if(meshUs < _phase) return _phase;
+    uint64_t base = meshUs - _phase;
+    return (base / _period + 1) * _period + _phase;
+}
+
+void MeshTicker::_onTick(uint64_t meshUs, void *arg) {
+    ((MeshTicker*)arg)->_tick(meshUs);
+}
+
+void MeshTicker::_onPulseEnd(uint64_t meshUs, void *arg) {
+    MeshTicker *ticker = (MeshTicker*)arg;
+    digitalWrite(ticker->_pin, LOW);
+}
+
+// esp_timer task. The pin goes first, so its edge carries the least latency.
+void MeshTicker::_tick(uint64_t meshUs) {
+    // Only the tick the chain expects runs: one end() could not cancel in
+    // time, or one begin() replaced, is dropped
+    uint64_t expected = meshUs;
+    if(!_pending.compare_exchange_strong(expected, 0) || !_running) return;
+
+    // A period or more behind (mesh time stepped over it): skip, counted
+    // as missed by the next tick that runs
+    if(_clock.meshMicros() - meshUs >= _period) {
+        if(_running) _schedule(_next(_clock.meshMicros()));
+        return;
+    }
+
+    uint64_t tick = (meshUs - _phase) / _period;  // Grid point from _next(), never before _phase
+    if(_pin >= 0) {
+        if(_pulseUs) {
+            digitalWrite(_pin, HIGH);
+            _clock.scheduleAt(meshUs + _pulseUs, _onPulseEnd, this);
+        } else {
+            digitalWrite(_pin, tick % 2 == 0 ? HIGH : LOW);
+        }
+    }
+    uint32_t late = (uint32_t)min(_clock.meshMicros() - meshUs, (uint64_t)UINT32_MAX);
+
+    // Ticks between the last one and this one did not run
+    portENTER_CRITICAL(&_statsLock);
+    if(_last && meshUs > _last + _period) _missed += (meshUs - _last) / _period - 1;
+    _ticks++;
+    _maxLate = max(_maxLate, late);
+    _lateSum += late;
+    _lateSq += (uint64_t)late * late;
+    portEXIT_CRITICAL(&_statsLock);
+    _last = meshUs;
+
+    if(_callback) _callback(tick, _arg);
+
+    // Next grid point after now: a step forward skips ticks, none is replayed
+    if(_running) _schedule(_next(max(_clock.meshMicros(), meshUs)));
+    else if(_pin >= 0) digitalWrite(_pin, LOW);  // end() ran during this tick
+}
@@ -0,0 +1,80 @@
+/*
+ * ESPNowMeshClock - phase-locked ticks on mesh time
+ * Copyright (c) 2025 maigre, Hemisphere-Project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <atomic>
+#include "ESPNowMeshClock.h"
+
+// Tick callback: tick number (mesh time / period, phase removed) and argument
+typedef void (*MeshTickCallback)(uint64_t tick, void *arg);
+
+// Lateness of the ticks at callback entry (mesh time minus tick time)
+struct MeshTickerStats {
+    uint32_t ticks;      // Ticks run since begin() or resetStats()
+    uint32_t missed;     // Ticks skipped (mesh time stepped over them, or the CPU was held up)
+    uint32_t maxLateUs;
+    float    meanLateUs;
+    float    jitterUs;   // Standard deviation of the lateness
+};
+
+// Periodic callbacks (and optionally a GPIO) on the mesh time grid: ticks
+// fall at every mesh time t with t % period == phase, so all nodes tick
+// together whatever their boot time, and a tick missed during a clock step
+// is skipped rather than replayed. Runs on scheduleAt() (esp_timer task).
+class MeshTicker {
+public:
+    MeshTicker(ESPNowMeshClock &clock);
+    ~MeshTicker();
+
+    // Start ticking every periodUs microseconds of mesh time, offset by
+    // phaseUs. callback may be nullptr when only the pin is wanted.
+    bool begin(uint32_t periodUs, MeshTickCallback callback = nullptr, void *arg = nullptr, uint32_t phaseUs = 0);
+    void end();
+
+    // Drive a pin from the ticks: a pulseUs wide HIGH pulse at each tick, or
+    // with pulseUs 0 a square wave (HIGH on even ticks, LOW on odd ones).
+    // Call before begin(); -1 for none.
+    void setPin(int pin, uint32_t pulseUs = 0) { _pin = pin; _pulseUs = pulseUs; }
+
+    MeshTickerStats getStats();
+    void resetStats();
+
+private:
+    ESPNowMeshClock &_clock;
+    uint32_t _period;
+    uint32_t _phase;
+    MeshTickCallback _callback;
+    void *_arg;
+    int      _pin;
+    uint32_t _pulseUs;
+    std::atomic<bool>     _running;
+    std::atomic<uint64_t> _pending;  // Mesh time of the one tick the chain expects (0 = none)
+    uint64_t _last;        // Mesh time of the last tick run (0 = none)
+    uint32_t _ticks;
+    uint32_t _missed;
+    uint32_t _maxLate;
+    uint64_t _lateSum;
+    uint64_t _lateSq;      // Sum of squared lateness, for the jitter
+    portMUX_TYPE _statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+    uint64_t _next(uint64_t meshUs);
+    bool _schedule(uint64_t at);
+    static void _onTick(uint64_t meshUs, void *arg);
+    static void _onPulseEnd(uint64_t meshUs, void *arg);
+    void _tick(uint64_t meshUs);
+};